@@ -21,7 +21,7 @@ def compile_lib():
     c_compile(
         src_files=src_files,
         common_opts=["-I", src_dir, "-fpic"],
-        link_opts=["-shared"],
+        link_opts=["-shared", "-pthread"],
         out_filename=lib_filename)
 
 
@@ -38,6 +38,18 @@ class ParseOggVorbisLib:
         self.ffi = cffi.FFI()
         self.ffi.cdef("""
             int ogg_vorbis_full_read_from_memory(const char* data, size_t data_len, const char** error_out);
+            int ogg_vorbis_full_read_from_memory_ex(
+                const char* data, size_t data_len, int crc_check, const char** error_out);
+            struct OggVorbisProbeInfo {
+                uint32_t sample_rate;
+                uint32_t channels;
+                int64_t num_samples;
+            };
+            int ogg_vorbis_probe_from_memory(
+                const char* data, size_t data_len, struct OggVorbisProbeInfo* info_out, const char** error_out);
+            int ogg_vorbis_decode_interleaved_from_memory(
+                const char* data, size_t data_len, int format, int dither,
+                void* out, size_t max_frames, size_t* num_frames_out, const char** error_out);
             void set_data_output_file(const char* fn);
             void set_data_filter(const char** allowed_names);
             """)
@@ -63,10 +75,57 @@ class ParseOggVorbisLib:
         self.lib.set_data_filter(
             [self.ffi.new("char[]", s.encode("utf8")) for s in data_names] + [self.ffi.NULL])
 
-    def decode_ogg_vorbis(self, raw_bytes, data_filter=None):
+    def probe_ogg_vorbis(self, raw_bytes):
+        """
+        Only parses the headers and the last page, i.e. does not decode the audio.
+
+        :param bytes raw_bytes:
+        :return: sample_rate, channels, num_samples
+        :rtype: (int,int,int)
+        """
+        info = self.ffi.new("struct OggVorbisProbeInfo*")
+        error_out = self.ffi.new("char**")
+        res = self.lib.ogg_vorbis_probe_from_memory(
+            self.ffi.new("char[]", raw_bytes), len(raw_bytes), info, error_out)
+        if res:
+            raise Exception(
+                "ParseOggVorbisLib ogg_vorbis_probe_from_memory error: %s" % (
+                    self.ffi.string(error_out[0]).decode("utf8")))
+        return info.sample_rate, info.channels, info.num_samples
+
+    PcmFormats = {"float32": (0, "float32"), "int16": (1, "int16"), "int24": (2, "int32")}
+
+    def decode_ogg_vorbis_pcm(self, raw_bytes, pcm_format="float32", dither=False):
+        """
+        Decodes the audio, converted and interleaved in C++.
+
+        :param bytes raw_bytes:
+        :param str pcm_format: "float32", "int16", or "int24" (right-aligned in int32)
+        :param bool dither: TPDF dither, for the int formats
+        :return: shape (time,channels)
+        :rtype: numpy.ndarray
+        """
+        format_id, dtype = self.PcmFormats[pcm_format]
+        _, channels, num_samples = self.probe_ogg_vorbis(raw_bytes)
+        out = numpy.zeros((max(num_samples, 0), channels), dtype=dtype)
+        num_frames_out = self.ffi.new("size_t*")
+        error_out = self.ffi.new("char**")
+        res = self.lib.ogg_vorbis_decode_interleaved_from_memory(
+            self.ffi.new("char[]", raw_bytes), len(raw_bytes), format_id, int(dither),
+            self.ffi.cast("void*", out.ctypes.data), out.shape[0], num_frames_out, error_out)
+        if res:
+            raise Exception(
+                "ParseOggVorbisLib ogg_vorbis_decode_interleaved_from_memory error: %s" % (
+                    self.ffi.string(error_out[0]).decode("utf8")))
+        return out[:num_frames_out[0]]
+
+    CrcChecks = {"verify": 0, "verify_lazily": 1, "skip": 2}
+
+    def decode_ogg_vorbis(self, raw_bytes, data_filter=None, crc_check="verify"):
         """
         :param bytes raw_bytes:
         :param list[str]|None data_filter:
+        :param str crc_check: "verify", "verify_lazily" (in background, error maybe reported later), or "skip"
         :rtype: CallbacksOutputReader
         """
         if data_filter:
@@ -79,8 +138,8 @@ class ParseOggVorbisLib:
             self.ffi.new("char[]", ("/dev/fd/%i" % callback_data_collector.write_fd).encode("utf8")))
 
         error_out = self.ffi.new("char**")
-        res = self.lib.ogg_vorbis_full_read_from_memory(
-            self.ffi.new("char[]", raw_bytes), len(raw_bytes), error_out)
+        res = self.lib.ogg_vorbis_full_read_from_memory_ex(
+            self.ffi.new("char[]", raw_bytes), len(raw_bytes), self.CrcChecks[crc_check], error_out)
         if res:
             # This means we got an error.
             raise Exception(
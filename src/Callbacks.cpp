@@ -346,6 +346,20 @@ void push_data_T(const void* ref, const char* name, int channel, const It& data,
 extern "C" void push_data_float(const void* ref, const char* name, int channel, const float* data, size_t len) {
 	push_data_T(ref, name, channel, data, data + len);
 }
+template<typename T>
+struct StridedIterator : std::iterator<std::forward_iterator_tag, T> {
+	const T* ptr;
+	size_t stride;
+	StridedIterator(const T* ptr_, size_t stride_) : ptr(ptr_), stride(stride_) {}
+	const T& operator*() const { return *ptr; }
+	StridedIterator& operator++() { ptr += stride; return *this; }
+	bool operator!=(const StridedIterator& other) const { return ptr != other.ptr; }
+	size_t operator-(const StridedIterator& other) const { return (ptr - other.ptr) / stride; }
+};
+
+extern "C" void push_data_float_strided(const void* ref, const char* name, int channel, const float* data, size_t len, size_t stride) {
+	push_data_T(ref, name, channel, StridedIterator<float>(data, stride), StridedIterator<float>(data + len * stride, stride));
+}
 extern "C" void push_data_i32(const void* ref, const char* name, int channel, const int32_t* data, size_t len) {
 	push_data_T(ref, name, channel, data, data + len);
 }
@@ -365,9 +379,21 @@ extern "C" void push_data_int(const void* ref, const char* name, int channel, co
 	push_data_T(ref, name, channel, data, data + len);
 }
 
+extern "C" int want_data(const void* ref, const char* name) {
+	Info& info = get_decoder(ref);
+	if(info.output_type == OutputType::OT_null)
+		return 0;
+	if(info.use_data_filter_names && info.data_name_filters.find(name) == info.data_name_filters.end())
+		return 0;
+	return 1;
+}
+
 void push_data_bool(const void* ref, const char* name, int channel, const std::vector<bool>& data) {
 	push_data_T(ref, name, channel, data.begin(), data.end());
 }
+void push_data_bool(const void* ref, const char* name, int channel, const bool* data, size_t len) {
+	push_data_T(ref, name, channel, data, data + len);
+}
 
 extern "C" const char* generic_itoa(uint32_t val, int base, int len) {
 	assert(base >= 2);
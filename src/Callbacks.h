@@ -68,12 +68,17 @@ void set_data_filter(const char** allowed_names);
 // Channel can be -1, if it does not apply.
 // data can be NULL, if no data. In that case, len is ignored.
 void push_data_float(const void* ref, const char* name, int channel, const float* data, size_t len);
+// data[i * stride] for i in [0, len), e.g. one channel of interleaved data.
+void push_data_float_strided(const void* ref, const char* name, int channel, const float* data, size_t len, size_t stride);
 void push_data_u8(const void* ref, const char* name, int channel, const uint8_t* data, size_t len);
 void push_data_i32(const void* ref, const char* name, int channel, const int32_t* data, size_t len);
 void push_data_u32(const void* ref, const char* name, int channel, const uint32_t* data, size_t len);
 void push_data_i64(const void* ref, const char* name, int channel, const int64_t* data, size_t len);
 void push_data_u64(const void* ref, const char* name, int channel, const uint64_t* data, size_t len);
 void push_data_int(const void* ref, const char* name, int channel, const int* data, size_t len);
+// Whether push_data_* with this name would output anything,
+// e.g. to skip some computation which is only needed for the pushed data.
+int want_data(const void* ref, const char* name);
 
 // General utilities.
 const char* generic_itoa(uint32_t val, int base, int len);
@@ -86,6 +91,7 @@ const char* generic_itoa(uint32_t val, int base, int len);
 
 // C++ only
 void push_data_bool(const void* ref, const char* name, int channel, const std::vector<bool>& data);
+void push_data_bool(const void* ref, const char* name, int channel, const bool* data, size_t len);
 
 struct ArgParser {
 	std::string ogg_filename;
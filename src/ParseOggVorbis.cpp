@@ -9,10 +9,7 @@
 #include <string.h>
 #include "ParseOggVorbis.hpp"
 
-extern "C" int ogg_vorbis_full_read(const char* filename, const char** error_out) {
-	ParseCallbacks dummy_callbacks;
-	OggReader reader(dummy_callbacks);
-	OkOrError result = reader.full_read(filename);
+static int return_result(const OkOrError& result, const char** error_out) {
 	if(result.is_error_) {
 		if(error_out) {
 			static char error_buf[255];
@@ -25,19 +22,65 @@ extern "C" int ogg_vorbis_full_read(const char* filename, const char** error_out
 	return 0;
 }
 
+extern "C" int ogg_vorbis_full_read(const char* filename, const char** error_out) {
+	ParseCallbacks dummy_callbacks;
+	OggReader reader(dummy_callbacks);
+	OkOrError result = reader.full_read(filename);
+	return return_result(result, error_out);
+}
+
 extern "C" int ogg_vorbis_full_read_from_memory(const char* data, size_t data_len, const char** error_out) {
+	return ogg_vorbis_full_read_from_memory_ex(data, data_len, CrcCheck_Verify, error_out);
+}
+
+extern "C" int ogg_vorbis_full_read_from_memory_ex(const char* data, size_t data_len, int crc_check, const char** error_out) {
 	ParseCallbacks dummy_callbacks;
 	OggReader reader(dummy_callbacks);
+	if(crc_check < CrcCheck_Verify || crc_check > CrcCheck_Skip)
+		return return_result(OkOrError("invalid crc_check " + std::to_string(crc_check)), error_out);
+	reader.set_crc_check((CrcCheck) crc_check);
 	OkOrError result = reader.full_read_from_memory((const uint8_t*) data, data_len);
-	if(result.is_error_) {
-		if(error_out) {
-			static char error_buf[255];
-			strncpy(error_buf, result.err_msg_.c_str(), sizeof(error_buf));
-			error_buf[sizeof(error_buf) - 1] = 0;
-			*error_out = error_buf;
-		}
-		return 1;
-	}
-	return 0;
+	return return_result(result, error_out);
 }
 
+
+static void set_probe_info(const OggReader::ProbeInfo& info, OggVorbisProbeInfo* info_out) {
+	info_out->sample_rate = info.header.audio_sample_rate;
+	info_out->channels = info.header.audio_channels;
+	info_out->num_samples = info.num_samples();
+}
+
+extern "C" int ogg_vorbis_probe(const char* filename, OggVorbisProbeInfo* info_out, const char** error_out) {
+	ParseCallbacks dummy_callbacks;
+	OggReader reader(dummy_callbacks);
+	OggReader::ProbeInfo info;
+	OkOrError result = reader.probe_file(filename, info);
+	if(!result.is_error_)
+		set_probe_info(info, info_out);
+	return return_result(result, error_out);
+}
+
+extern "C" int ogg_vorbis_probe_from_memory(const char* data, size_t data_len, OggVorbisProbeInfo* info_out, const char** error_out) {
+	ParseCallbacks dummy_callbacks;
+	OggReader reader(dummy_callbacks);
+	OggReader::ProbeInfo info;
+	OkOrError result = reader.probe_from_memory((const uint8_t*) data, data_len, info);
+	if(!result.is_error_)
+		set_probe_info(info, info_out);
+	return return_result(result, error_out);
+}
+
+extern "C" int ogg_vorbis_decode_interleaved_from_memory(
+	const char* data, size_t data_len, int format, int dither,
+	void* out, size_t max_frames, size_t* num_frames_out, const char** error_out
+) {
+	if(format < PcmFormat_Float32 || format > PcmFormat_Int24)
+		return return_result(OkOrError("invalid format " + std::to_string(format)), error_out);
+	InterleavedPcmSink sink((PcmFormat) format, out, max_frames, dither != 0);
+	OggReader reader(sink);
+	OkOrError result = reader.full_read_from_memory((const uint8_t*) data, data_len);
+	if(result.is_error_ && sink.num_frames >= max_frames)
+		result = OkOrError("output buffer too small, " + std::to_string(max_frames) + " frames. " + result.err_msg_);
+	*num_frames_out = sink.num_frames;
+	return return_result(result, error_out);
+}
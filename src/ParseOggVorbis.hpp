@@ -15,6 +15,11 @@
 #include <map>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
 #include <algorithm>
 #include <assert.h>
 #include <stdio.h>
@@ -24,6 +29,7 @@
 #include "Utils.hpp"
 #include "inverse_db_table.h"
 #include "mdct.h"
+#include "Simd.hpp"
 #include "Callbacks.h"
 
 
@@ -60,47 +66,270 @@ struct __attribute__((packed)) PageHeader {
 };
 
 struct Page {
-	PageHeader header;
-	uint8_t segment_table[256]; // page_segments_num in len
+	PageHeader header; // always a copy, because we modify it (endianness, CRC check)
+	// Either point into the reader data (IReader::view), or to our own buffers below.
+	const uint8_t* segment_table; // page_segments_num in len
 	uint32_t data_len;
-	uint8_t data[256 * 256];
+	const uint8_t* data;
+	uint8_t segment_table_buf_[256];
+	uint8_t data_buf_[255 * 255];
+
+	Page() : segment_table(segment_table_buf_), data_len(0), data(data_buf_) {}
 
 	enum ReadHeaderResult { Ok, Eof, Error };
 	ReadHeaderResult read_header(IReader* reader) {
-		size_t c = reader->read(&header, sizeof(PageHeader), 1);
-		if(c == 1) return ReadHeaderResult::Ok;
+		if(reader->supportsView()) {
+			const uint8_t* ptr = reader->view(sizeof(PageHeader));
+			if(ptr) {
+				memcpy(&header, ptr, sizeof(PageHeader));
+				return ReadHeaderResult::Ok;
+			}
+		}
+		else {
+			size_t c = reader->read(&header, sizeof(PageHeader), 1);
+			if(c == 1) return ReadHeaderResult::Ok;
+		}
 		if(reader->reachedEnd()) return ReadHeaderResult::Eof;
 		return ReadHeaderResult::Error;
 	}
 
-	OkOrError read(IReader* reader) {
+	OkOrError read(IReader* reader, bool verify_crc = true) {
+		CHECK_ERR(prepare_header());
+
+		if(reader->supportsView()) {
+			segment_table = reader->view(header.page_segments_num);
+			CHECK(segment_table);
+		}
+		else {
+			CHECK(reader->read(segment_table_buf_, header.page_segments_num, 1) == 1);
+			segment_table = segment_table_buf_;
+		}
+		data_len = 0;
+		for(uint8_t i = 0; i < header.page_segments_num; ++i)
+			data_len += segment_table[i];
+		if(reader->supportsView()) {
+			data = reader->view(data_len);
+			CHECK(data);
+		}
+		else {
+			CHECK(reader->read(data_buf_, data_len, 1) == 1);
+			data = data_buf_;
+		}
+
+		if(verify_crc)
+			CHECK(calc_crc(header, segment_table, data, data_len) == header.page_crc_checksum);
+		return OkOrError();
+	}
+
+	// Checks the header and converts it from little endian. Called once the header is read.
+	OkOrError prepare_header() {
 		CHECK(memcmp(header.capture_pattern, "OggS", 4) == 0);
 		CHECK(header.stream_structure_version == 0);
 		endian_swap_to_little_endian(header.absolute_granule_pos);
 		endian_swap_to_little_endian(header.stream_serial_num);
 		endian_swap_to_little_endian(header.page_sequence_num);
 		endian_swap_to_little_endian(header.page_crc_checksum);
+		return OkOrError();
+	}
 
-		CHECK(reader->read(segment_table, header.page_segments_num, 1) == 1);
-		data_len = 0;
+	enum { MaxPageSize = sizeof(PageHeader) + 255 + 255 * 255 };
+
+	// Checks whether there is a complete valid page (incl CRC) at buf.
+	// Returns its total size, or 0 if not. For resyncing on the capture pattern.
+	static size_t check_page_in_buffer(const uint8_t* buf, size_t len, PageHeader& header_out) {
+		if(len < sizeof(PageHeader)) return 0;
+		if(memcmp(buf, "OggS", 4) != 0) return 0;
+		PageHeader header;
+		memcpy(&header, buf, sizeof(PageHeader));
+		if(header.stream_structure_version != 0) return 0;
+		endian_swap_to_little_endian(header.absolute_granule_pos);
+		endian_swap_to_little_endian(header.stream_serial_num);
+		endian_swap_to_little_endian(header.page_sequence_num);
+		endian_swap_to_little_endian(header.page_crc_checksum);
+		const uint8_t* segment_table = buf + sizeof(PageHeader);
+		if(len < sizeof(PageHeader) + header.page_segments_num) return 0;
+		uint32_t data_len = 0;
 		for(uint8_t i = 0; i < header.page_segments_num; ++i)
 			data_len += segment_table[i];
-		if(header.page_segments_num > 0)
-			CHECK(segment_table[header.page_segments_num - 1] != 255); // packets spanning pages not supported currently...
-		CHECK(reader->read(data, data_len, 1) == 1);
+		size_t page_len = sizeof(PageHeader) + header.page_segments_num + data_len;
+		if(len < page_len) return 0;
+		if(calc_crc(header, segment_table, segment_table + header.page_segments_num, data_len) != header.page_crc_checksum)
+			return 0;
+		header_out = header;
+		return page_len;
+	}
 
-		uint32_t expected_crc = header.page_crc_checksum;
+	static uint32_t calc_crc(PageHeader header, const uint8_t* segment_table, const uint8_t* data, uint32_t data_len) {
 		header.page_crc_checksum = 0; // required by API
-		uint32_t calculated_crc = 0;
-		calculated_crc = update_crc(calculated_crc, (uint8_t*) &header, sizeof(PageHeader));
-		calculated_crc = update_crc(calculated_crc, segment_table, header.page_segments_num);
-		calculated_crc = update_crc(calculated_crc, data, data_len);
-		CHECK(expected_crc == calculated_crc);
-		header.page_crc_checksum = calculated_crc;
-		return OkOrError();
+		uint32_t crc = 0;
+		crc = update_crc(crc, (const uint8_t*) &header, sizeof(PageHeader));
+		crc = update_crc(crc, segment_table, header.page_segments_num);
+		crc = update_crc(crc, data, data_len);
+		return crc;
 	}
 };
 
+enum CrcCheck {
+	CrcCheck_Verify = 0, // verify every page before we use it. With OggReader::feed, the latency is one page then
+	CrcCheck_VerifyLazily = 1, // verify in a background thread, a mismatch is reported with some delay
+	CrcCheck_Skip = 2 // no verification
+};
+
+struct PageCrcWorker;
+
+struct PageCrcVerifier {
+	// For CrcCheck_VerifyLazily: Verifies the page CRCs in the background, in the PageCrcWorker thread.
+	// The page data must stay valid until finish(), i.e. this only works with IReader::view.
+	struct Job {
+		PageHeader header;
+		const uint8_t* segment_table;
+		const uint8_t* data;
+		uint32_t data_len;
+	};
+	PageCrcWorker& worker_;
+	size_t num_pending_; // guarded by PageCrcWorker::mutex_
+	std::atomic<bool> has_error_;
+	std::string err_msg_; // guarded by PageCrcWorker::mutex_
+
+	PageCrcVerifier();
+	~PageCrcVerifier(); // drops the pending pages, the data might not be valid anymore
+	PageCrcVerifier(const PageCrcVerifier&) = delete;
+	PageCrcVerifier& operator=(const PageCrcVerifier&) = delete;
+
+	void push(const Page& page);
+
+	// Does not wait. Returns an error if some mismatch was found since the last call.
+	// The error is reported only once, such that the verifier (and the OggReader) can be used further.
+	OkOrError take_error();
+
+	// Waits until all pushed pages are verified.
+	OkOrError finish() {
+		_wait();
+		return take_error();
+	}
+
+	// Like finish(), but drops any mismatch, e.g. when the pages belong to a reader which we do not use anymore.
+	void drain() {
+		_wait();
+		take_error();
+	}
+
+	void _wait();
+};
+
+struct PageCrcWorker {
+	// A single background thread for all PageCrcVerifier instances (i.e. all OggReaders), started on the first page.
+	// Verifying the CRC is much cheaper than decoding, so one thread keeps up with many readers,
+	// and we avoid a thread start per OggReader, which would dominate for small files.
+	std::mutex mutex_;
+	std::condition_variable cond_; // new jobs, or stop
+	std::condition_variable done_cond_; // some verifier has no pending jobs anymore
+	std::deque<std::pair<PageCrcVerifier*, PageCrcVerifier::Job>> jobs_;
+	PageCrcVerifier* busy_verifier_; // the job of this verifier is checked right now, without the lock
+	bool stop_;
+	std::thread thread_;
+
+	PageCrcWorker() : busy_verifier_(nullptr), stop_(false) {}
+	~PageCrcWorker() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cond_.notify_all();
+		if(thread_.joinable())
+			thread_.join();
+	}
+
+	static PageCrcWorker& instance() {
+		static PageCrcWorker worker;
+		return worker;
+	}
+
+	void push(PageCrcVerifier* verifier, const PageCrcVerifier::Job& job) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(!thread_.joinable())
+				thread_ = std::thread(&PageCrcWorker::_thread_loop, this);
+			jobs_.emplace_back(verifier, job);
+			++verifier->num_pending_;
+		}
+		cond_.notify_all();
+	}
+
+	void wait(PageCrcVerifier* verifier) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while(verifier->num_pending_ > 0)
+			done_cond_.wait(lock);
+	}
+
+	// Removes the pending jobs of the verifier, and waits if one of its jobs is checked right now.
+	void cancel(PageCrcVerifier* verifier) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		for(auto it = jobs_.begin(); it != jobs_.end();) {
+			if(it->first == verifier) {
+				it = jobs_.erase(it);
+				--verifier->num_pending_;
+			}
+			else
+				++it;
+		}
+		while(busy_verifier_ == verifier)
+			done_cond_.wait(lock);
+	}
+
+	void _thread_loop() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while(true) {
+			while(jobs_.empty() && !stop_)
+				cond_.wait(lock);
+			if(stop_)
+				break;
+			PageCrcVerifier* verifier = jobs_.front().first;
+			PageCrcVerifier::Job job = jobs_.front().second;
+			jobs_.pop_front();
+			busy_verifier_ = verifier;
+			lock.unlock();
+			bool ok = Page::calc_crc(job.header, job.segment_table, job.data, job.data_len) == job.header.page_crc_checksum;
+			lock.lock();
+			busy_verifier_ = nullptr;
+			--verifier->num_pending_;
+			if(!ok && !verifier->has_error_) {
+				verifier->err_msg_ = "CRC mismatch in page " + std::to_string(job.header.page_sequence_num) + " of stream " + std::to_string(job.header.stream_serial_num);
+				verifier->has_error_ = true;
+			}
+			done_cond_.notify_all();
+		}
+	}
+};
+
+// Gets the worker already here, such that it is destroyed after any static OggReader.
+inline PageCrcVerifier::PageCrcVerifier() : worker_(PageCrcWorker::instance()), num_pending_(0), has_error_(false) {}
+
+inline PageCrcVerifier::~PageCrcVerifier() {
+	worker_.cancel(this);
+}
+
+inline void PageCrcVerifier::push(const Page& page) {
+	Job job;
+	job.header = page.header;
+	job.segment_table = page.segment_table;
+	job.data = page.data;
+	job.data_len = page.data_len;
+	worker_.push(this, job);
+}
+
+inline OkOrError PageCrcVerifier::take_error() {
+	if(!has_error_)
+		return OkOrError();
+	std::lock_guard<std::mutex> lock(worker_.mutex_);
+	has_error_ = false;
+	return OkOrError(err_msg_);
+}
+
+inline void PageCrcVerifier::_wait() {
+	worker_.wait(this);
+}
+
 struct __attribute__((packed)) VorbisIdHeader { // used in VorbisStream
 	// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 4.2.2. Identification header
 	uint32_t vorbis_version;
@@ -133,12 +362,14 @@ struct VorbisCodebook { // used in VorbisStreamSetup
 		}
 	};
 	std::vector<Entry> entries_;
-	struct EntryLookup {
-		uint32_t next_idx; // if 0, we have codeword. otherwise next immediate is for 0bit, next_idx is for 1bit
-		uint32_t num;
-		EntryLookup(uint32_t next, uint32_t v) : next_idx(next), num(v) {}
+	struct DecodeTableEntry {
+		uint32_t value; // if sub_bits == 0, the entry num. otherwise the offset of the subtable in decode_table_
+		uint8_t len; // number of bits to consume at this table level
+		uint8_t sub_bits; // if > 0, we need to continue in the subtable, indexed by the next sub_bits bits
 	};
-	std::vector<EntryLookup> entries_lookup_;
+	enum { DecodeTableMaxBits = 10 };
+	std::vector<DecodeTableEntry> decode_table_; // calculated via _buildDecodeTable()
+	uint8_t decode_table_bits_; // index bits of the first level table
 	uint8_t lookup_type_;
 	double minimum_value_;
 	double delta_value_;
@@ -184,29 +415,101 @@ struct VorbisCodebook { // used in VorbisStreamSetup
 		CHECK(marker[31] == 0); // underspecified
 
 		// Now build up the codeword lookup.
-		entries_lookup_.reserve(entries_.size() * 2);
-		_buildEntriesLookup(0, 0);
+		// Sort by the left-aligned codeword (i.e. canonical order). Then codewords with a common prefix are contiguous,
+		// and the decode table can be built in a single pass over the sorted entries.
+		std::vector<uint32_t> sorted;
+		_sortEntriesByCodeword(sorted);
+		CHECK_ERR(_checkPrefixFree(sorted));
+		_buildDecodeTable(sorted);
+
+		return OkOrError();
+	}
 
+	void _sortEntriesByCodeword(std::vector<uint32_t>& sorted) const {
+		// Key: left-aligned codeword in the upper 32 bits, index into entries_ in the lower 32 bits.
+		std::vector<uint64_t> keys(entries_.size());
+		for(uint32_t i = 0; i < entries_.size(); ++i)
+			keys[i] = (uint64_t(entries_[i].codeword_ << (32 - entries_[i].len_)) << 32) | i;
+		std::sort(keys.begin(), keys.end());
+		sorted.resize(entries_.size());
+		for(uint32_t i = 0; i < entries_.size(); ++i)
+			sorted[i] = uint32_t(keys[i]);
+	}
+
+	OkOrError _checkPrefixFree(const std::vector<uint32_t>& sorted) const {
+		// In canonical order, a codeword which is a prefix of another one directly precedes it,
+		// so it is enough to compare consecutive codewords.
+		for(size_t i = 1; i < sorted.size(); ++i) {
+			const Entry& prev = entries_[sorted[i - 1]];
+			const Entry& entry = entries_[sorted[i]];
+			uint32_t prev_word = prev.codeword_ << (32 - prev.len_); // left-aligned
+			uint32_t word = entry.codeword_ << (32 - entry.len_);
+			CHECK(word != prev_word); // overspecified
+			CHECK(__builtin_clz(word ^ prev_word) < prev.len_); // not prefix-free
+		}
 		return OkOrError();
 	}
 
-	void _buildEntriesLookup(uint32_t baseCodeword, uint8_t bitOffset) {
-		assert(bitOffset < 32);
-		if(bitOffset > 0) {
-			for(const Entry& entry : entries_) {
-				if(entry.len_ == bitOffset && entry.codeword_ == baseCodeword) {
-					entries_lookup_.push_back(EntryLookup(0, entry.num_));
-					return;
+	static uint32_t _reverseBits(uint32_t v, uint8_t len) {
+		uint32_t r = 0;
+		for(uint8_t i = 0; i < len; ++i, v >>= 1)
+			r = (r << 1) | (v & 1);
+		return r;
+	}
+
+	void _buildDecodeTable(const std::vector<uint32_t>& sorted) {
+		// Table-driven decoding, similar to libvorbis (codebook.c, sharedbook.c).
+		// The bitstream contains the codeword MSb first, while the PacketBitReader gives us the LSb first,
+		// thus the table index is the bit-reversed codeword (prefix).
+		// Codewords longer than decode_table_bits_ continue in subtables.
+		uint8_t max_len = 0;
+		for(const Entry& entry : entries_)
+			max_len = std::max(max_len, entry.len_);
+		decode_table_bits_ = std::min(max_len, uint8_t(DecodeTableMaxBits));
+		decode_table_.clear();
+		decode_table_.resize(size_t(1) << decode_table_bits_, DecodeTableEntry{0, 0, 0});
+		_buildDecodeSubtable(sorted, 0, decode_table_bits_, 0, (uint32_t) sorted.size(), 0);
+	}
+
+	void _buildDecodeSubtable(const std::vector<uint32_t>& sorted, uint32_t table_offset, uint8_t bits, uint32_t begin, uint32_t end, uint8_t depth) {
+		// All entries in sorted[begin:end] share the first depth bits of their codeword.
+		for(uint32_t i = begin; i < end;) {
+			const Entry& entry = entries_[sorted[i]];
+			assert(entry.len_ > depth);
+			uint8_t rem_len = entry.len_ - depth;
+			if(rem_len <= bits) {
+				uint32_t idx = _reverseBits(entry.codeword_, rem_len);
+				for(uint32_t k = 0; k < (uint32_t(1) << (bits - rem_len)); ++k) {
+					DecodeTableEntry& e = decode_table_[table_offset + idx + (k << rem_len)];
+					assert(e.len == 0);
+					e.value = entry.num_;
+					e.len = rem_len;
+					e.sub_bits = 0;
 				}
+				++i;
+				continue;
 			}
+			// Longer codeword. Collect all with the same next bits.
+			uint32_t chunk = (entry.codeword_ >> (rem_len - bits)) & ((uint32_t(1) << bits) - 1);
+			uint32_t group_end = i;
+			uint8_t group_max_len = 0;
+			for(; group_end < end; ++group_end) {
+				const Entry& other = entries_[sorted[group_end]];
+				if(other.len_ - depth <= bits) break;
+				if(((other.codeword_ >> (other.len_ - depth - bits)) & ((uint32_t(1) << bits) - 1)) != chunk) break;
+				group_max_len = std::max(group_max_len, other.len_);
+			}
+			uint8_t sub_bits = std::min(uint8_t(group_max_len - depth - bits), uint8_t(DecodeTableMaxBits));
+			uint32_t sub_offset = (uint32_t) decode_table_.size();
+			decode_table_.resize(decode_table_.size() + (size_t(1) << sub_bits), DecodeTableEntry{0, 0, 0});
+			DecodeTableEntry& e = decode_table_[table_offset + _reverseBits(chunk, bits)];
+			assert(e.len == 0);
+			e.value = sub_offset;
+			e.len = bits;
+			e.sub_bits = sub_bits;
+			_buildDecodeSubtable(sorted, sub_offset, sub_bits, i, group_end, depth + bits);
+			i = group_end;
 		}
-		uint32_t myLookupIdx = (uint32_t) entries_lookup_.size();
-		entries_lookup_.push_back(EntryLookup(0, 0)); // will write below
-		uint32_t word1 = baseCodeword << 1;
-		uint32_t word2 = word1 | 1;
-		_buildEntriesLookup(word1, bitOffset + 1);
-		entries_lookup_[myLookupIdx].next_idx = (uint32_t) entries_lookup_.size();
-		_buildEntriesLookup(word2, bitOffset + 1);
 	}
 
 	void _buildVQ() {
@@ -244,7 +547,7 @@ struct VorbisCodebook { // used in VorbisStreamSetup
 		else assert(false); // invalid lookup_type_
 	}
 
-	OkOrError parse(BitReader& reader) {
+	OkOrError parse(PacketBitReader& reader) {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 3.2.1
 		// https://github.com/runningwild/gorbis/blob/master/vorbis/codebook.go
 		// https://github.com/ioctlLR/NVorbis/blob/master/NVorbis/VorbisCodebook.cs
@@ -328,7 +631,8 @@ struct VorbisCodebook { // used in VorbisStreamSetup
 		return OkOrError();
 	}
 
-	uint32_t decodeScalar_slow(BitReader& reader) const {
+	uint32_t decodeScalar_slow(PacketBitReader& reader) const {
+		// Directly as in the spec, the reference for decodeScalar_table (see tests/test_Codebook.cpp).
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 3.2.1.
 		// https://github.com/runningwild/gorbis/blob/master/vorbis/codebook.go
 		uint32_t word = 0;
@@ -344,27 +648,26 @@ struct VorbisCodebook { // used in VorbisStreamSetup
 		return uint32_t(-1);
 	}
 
-	uint32_t decodeScalar_fast(BitReader& reader) const {
-		uint32_t lookupIdx = 0;
-		for(uint8_t len = 0; len < 32; ++len) {
-			if(entries_lookup_[lookupIdx].next_idx == 0)
-				return entries_lookup_[lookupIdx].num;
-			bool curBit = reader.readBitsT<1>();
-			if(!curBit)
-				++lookupIdx;
-			else
-				lookupIdx = entries_lookup_[lookupIdx].next_idx;
+	uint32_t decodeScalar_table(PacketBitReader& reader) const {
+		uint32_t offset = 0;
+		uint8_t bits = decode_table_bits_;
+		while(true) {
+			const DecodeTableEntry& e = decode_table_[offset + reader.peekBits(bits)];
+			assert(e.len > 0); // we checked in _assignCodewords that we are fully specified
+			reader.consumeBits(e.len);
+			if(e.sub_bits == 0)
+				return e.value;
+			offset = e.value;
+			bits = e.sub_bits;
 		}
-		assert(false); // should not be possible, because we checked in _assignCodewords that we are fully specified
-		return uint32_t(-1);
 	}
 
-	uint32_t decodeScalar(BitReader& reader) const {
-		return decodeScalar_fast(reader);
+	uint32_t decodeScalar(PacketBitReader& reader) const {
+		return decodeScalar_table(reader);
 	}
 
 	// Returns vector of size dimensions_, or empty if invalid.
-	DataRange<const float> decodeVector(BitReader& reader) const {
+	DataRange<const float> decodeVector(PacketBitReader& reader) const {
 		uint32_t idx = decodeScalar(reader);
 		if(lookup_type_ == 0) return DataRange<const float>(); // actually this is invalid
 		if(idx >= num_entries_) return DataRange<const float>(); // invalid idx
@@ -381,26 +684,127 @@ struct VorbisFloor0 {
 	uint8_t amplitude_bits;
 	uint8_t amplitude_offset;
 	std::vector<uint8_t> books;
+	uint16_t max_book_dimensions;
+	// The curve computation (6.2.3) only depends on the setup and the blocksize, so we precalculate it here.
+	// The bark map is non-decreasing, and the curve is constant where the map is.
+	// Thus we keep the runs of equal map values: map[i] is the same for i in [run_begin[r], run_begin[r + 1]).
+	struct CurveMap {
+		uint32_t n; // blocksize / 2
+		std::vector<uint32_t> run_begin; // num runs + 1 entries, the last is n
+		std::vector<float> run_cos; // per run, 2 cos(omega), omega = pi * map[i] / bark_map_size
+	};
+	CurveMap curve_maps[2]; // for blocksize 0 and 1
 
-	OkOrError parse(BitReader& reader, int max_books) {
+	OkOrError parse(PacketBitReader& reader, const std::vector<VorbisCodebook>& codebooks, const VorbisIdHeader& header) {
+		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 6.2.1
 		order = reader.readBitsT<8>();
 		rate = reader.readBitsT<16>();
 		bark_map_size = reader.readBitsT<16>();
 		amplitude_bits = reader.readBitsT<6>();
 		amplitude_offset = reader.readBitsT<8>();
+		CHECK(order >= 1 && rate >= 1 && bark_map_size >= 1);
 		int num_books = reader.readBitsT<4>() + 1;
 		books.resize(num_books);
+		max_book_dimensions = 0;
 		for(int i = 0; i < num_books; ++i) {
 			books[i] = reader.readBitsT<8>();
-			CHECK(books[i] < max_books);
+			CHECK(books[i] < codebooks.size());
+			// We need vectors from it (VQ context).
+			const VorbisCodebook& book = codebooks[books[i]];
+			CHECK(book.lookup_type_ != 0 && book.dimensions_ >= 1);
+			max_book_dimensions = std::max(max_book_dimensions, book.dimensions_);
 		}
+		_init_curve_map(curve_maps[0], header.get_blocksize_0() / 2);
+		_init_curve_map(curve_maps[1], header.get_blocksize_1() / 2);
 		return OkOrError();
 	}
 
-	OkOrError decode(BitReader& reader, const std::vector<VorbisCodebook>& codebooks, DataRange<float>& out, bool& use_output) const {
+	// bark(x) (6.2.3), with the float and double steps as toBARK in libvorbis (scales.h), to get the same map.
+	static double bark(float x) {
+		return 13.1f * atan(double(.00074f * x)) + 2.24f * atan(double(x * x * 1.85e-8f)) + double(1e-4f * x);
+	}
+
+	void _init_curve_map(CurveMap& curve_map, uint32_t n) const {
+		// map[i] = min(bark_map_size - 1, floor(bark((rate * i) / (2 * n)) * bark_map_size / bark(.5 * rate)))
+		// Calculated like libvorbis (floor0_map_lazy_init), which differs from the spec formula only in the float rounding.
+		float scale = float(bark_map_size / bark(rate / 2.f));
+		float wdel = float(M_PI / bark_map_size);
+		curve_map.n = n;
+		curve_map.run_begin.clear();
+		curve_map.run_cos.clear();
+		int32_t last_k = -1;
+		for(uint32_t i = 0; i < n; ++i) {
+			int32_t k = (int32_t) floor(bark(rate / 2.f / float(n) * float(i)) * scale);
+			if(k >= bark_map_size)
+				k = bark_map_size - 1; // guard against the approximation
+			if(k == last_k)
+				continue;
+			curve_map.run_begin.push_back(i);
+			curve_map.run_cos.push_back(float(2. * cos(double(wdel * float(k)))));
+			last_k = k;
+		}
+		curve_map.run_begin.push_back(n);
+	}
+
+	// Upper bound of the scratch usage of decode (per channel), see VorbisDecoderContext::scratch_size.
+	size_t scratch_size() const {
+		size_t max_runs = std::max(curve_maps[0].run_cos.size(), curve_maps[1].run_cos.size());
+		// coefficients, their cosines, the curve per run
+		return (size_t(order) + max_book_dimensions + order + max_runs) * sizeof(float) + 3 * ScratchArena::Alignment;
+	}
+
+	// The temporary buffers are from scratch (see VorbisStreamDecodeState::scratch).
+	// debug_ref is used for the debug push_data_* calls.
+	OkOrError decode(PacketBitReader& reader, const std::vector<VorbisCodebook>& codebooks, DataRange<float>& out, bool& use_output, ScratchArena& scratch, const void* debug_ref) const {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 6.2.2
-		CHECK(false); // not implemented. but rarely used anyway?
-		(void) reader; (void) codebooks; (void) out; (void) use_output; // remove warnings
+		// https://github.com/xiph/vorbis/blob/master/lib/floor0.c
+		uint64_t amplitude = reader.readBits<uint64_t>(amplitude_bits);
+		if(amplitude == 0) {
+			use_output = false; // nothing, no audio. this is valid
+			return OkOrError();
+		}
+		uint32_t book_number = reader.readBits<uint32_t>(highest_bit(books.size()));
+		if(book_number >= books.size()) {
+			// The spec says the packet is undecodable. libvorbis treats the floor as unused, and so do we.
+			use_output = false;
+			return OkOrError();
+		}
+		use_output = true;
+		const VorbisCodebook& book = codebooks[books[book_number]];
+
+		// Read the vectors, each with the last scalar of the previous one added, until we have [order] coefficients.
+		// The last vector can go beyond order, thus the extra space.
+		DataRange<float> coefficients = scratch.alloc<float>(size_t(order) + max_book_dimensions);
+		{
+			size_t num_coefficients = 0;
+			float last = 0;
+			while(num_coefficients < order) {
+				DataRange<const float> vec = book.decodeVector(reader);
+				CHECK(vec.size() > 0);
+				for(size_t i = 0; i < vec.size(); ++i)
+					coefficients[num_coefficients + i] = vec[i] + last;
+				num_coefficients += vec.size();
+				last = coefficients[num_coefficients - 1];
+			}
+		}
+		push_data_float(debug_ref, "floor0 coefficients", -1, coefficients.begin(), order);
+
+		// Compute the curve (6.2.3).
+		const CurveMap& curve_map = (out.size() == curve_maps[0].n) ? curve_maps[0] : curve_maps[1];
+		CHECK(out.size() == curve_map.n);
+		DataRange<float> lsp = scratch.alloc<float>(order);
+		for(size_t j = 0; j < order; ++j)
+			lsp[j] = float(2. * cos(double(coefficients[j])));
+		size_t num_runs = curve_map.run_cos.size();
+		DataRange<float> sums = scratch.alloc<float>(num_runs);
+		simd_lsp_curve(sums.begin(), &curve_map.run_cos[0], num_runs, lsp.begin(), order);
+		// linear_floor_value = exp(.11512925 * (amplitude * amplitude_offset / ((2 ^ amplitude_bits - 1) * sqrt(p + q)) - amplitude_offset))
+		float amp = float(amplitude) / float((uint64_t(1) << amplitude_bits) - 1) * float(amplitude_offset);
+		float* ptr = out.begin();
+		for(size_t r = 0; r < num_runs; ++r) {
+			float value = float(exp((amp / sqrt(double(sums[r])) - amplitude_offset) * .11512925f));
+			std::fill(ptr + curve_map.run_begin[r], ptr + curve_map.run_begin[r + 1], value);
+		}
 		return OkOrError();
 	}
 };
@@ -421,8 +825,10 @@ struct VorbisFloor1 {
 	std::vector<x_t> xs;
 	std::vector<size_t> xs_sorted_idx;
 	std::vector<x_t> xs_sorted;
+	// low_neighbor / high_neighbor (9.2.4, 9.2.5) of xs, for i >= 2. xs.size() <= 2 + 31 * 8.
+	std::vector<uint8_t> xs_low_neighbor, xs_high_neighbor;
 
-	OkOrError parse(BitReader& reader) {
+	OkOrError parse(PacketBitReader& reader) {
 		int num_partitions = reader.readBitsT<5>();
 		int max_class = -1;
 		partition_classes.resize(num_partitions);
@@ -467,10 +873,23 @@ struct VorbisFloor1 {
 		xs_sorted.resize(xs.size());
 		for(size_t i = 0; i < xs.size(); ++i)
 			xs_sorted[i] = xs[xs_sorted_idx[i]];
+
+		// The neighbors only depend on xs, so decode does not need to search them for every packet.
+		xs_low_neighbor.assign(xs.size(), 0);
+		xs_high_neighbor.assign(xs.size(), 0);
+		for(size_t i = 2; i < xs.size(); ++i) {
+			size_t low_idx = low_neighbor(xs, i);
+			size_t high_idx = high_neighbor(xs, i);
+			CHECK(low_idx < i && high_idx < i); // not found, e.g. xs[i] == 0
+			xs_low_neighbor[i] = uint8_t(low_idx);
+			xs_high_neighbor[i] = uint8_t(high_idx);
+		}
 		return OkOrError();
 	}
 
-	OkOrError decode(BitReader& reader, const std::vector<VorbisCodebook>& codebooks, DataRange<float>& out, bool& use_output) const {
+	// The temporary buffers are from scratch (see VorbisStreamDecodeState::scratch).
+	// debug_ref is used for the debug push_data_* calls (the floor itself might be shared by multiple streams).
+	OkOrError decode(PacketBitReader& reader, const std::vector<VorbisCodebook>& codebooks, DataRange<float>& out, bool& use_output, ScratchArena& scratch, const void* debug_ref) const {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 7.2.3
 		// https://github.com/runningwild/gorbis/blob/master/vorbis/codec.go
 		// https://github.com/runningwild/gorbis/blob/master/vorbis/floor.go
@@ -495,10 +914,11 @@ struct VorbisFloor1 {
 		// These floor y values relate to the floor x values from the setup header.
 		// The floor y values (multiplied by the multiplier) are in the end
 		// looked up in inverse_db_table (256 entries).
-		std::vector<y_t> ys;
+		DataRange<y_t> ys = scratch.alloc<y_t>(xs.size());
 		{
-			ys.push_back(reader.readBits<y_t>(highest_bit(range - 1)));
-			ys.push_back(reader.readBits<y_t>(highest_bit(range - 1)));
+			size_t num_ys = 0;
+			ys[num_ys++] = reader.readBits<y_t>(highest_bit(range - 1));
+			ys[num_ys++] = reader.readBits<y_t>(highest_bit(range - 1));
 			for(uint8_t class_idx : partition_classes) {
 				const VorbisFloorClass& cl = classes[class_idx];
 				uint8_t class_dim = cl.dimensions;
@@ -511,34 +931,32 @@ struct VorbisFloor1 {
 					CHECK((cval & csub) < cl.subclass_books.size());
 					int book = cl.subclass_books[cval & csub];
 					cval = cval >> class_bits;
-					ys.push_back((book >= 0) ? codebooks[book].decodeScalar(reader) : 0);
+					ys[num_ys++] = (book >= 0) ? codebooks[book].decodeScalar(reader) : 0;
 				}
 			}
+			CHECK(num_ys == xs.size());
 		}
-		push_data_u32(this, "floor1 ys", -1, &ys[0], ys.size());
-		CHECK(ys.size() == xs.size());
+		push_data_u32(debug_ref, "floor1 ys", -1, ys.begin(), ys.size());
 
 		// Compute curves (7.2.4).
 		// Step 1: Amplitude value synthesis (7.2.4).
-		std::vector<bool> step2_flag;
-		step2_flag.resize(xs.size());
+		DataRange<bool> step2_flag = scratch.alloc<bool>(xs.size());
 		step2_flag[0] = true;
 		step2_flag[1] = true;
-		std::vector<y_t> final_ys;
-		final_ys.resize(xs.size());
+		DataRange<y_t> final_ys = scratch.alloc<y_t>(xs.size());
 		final_ys[0] = ys[0];
 		final_ys[1] = ys[1];
 		for(size_t i = 2; i < xs.size(); ++i) {
-			size_t low_idx = low_neighbor(xs, i);
-			size_t high_idx = high_neighbor(xs, i);
+			size_t low_idx = xs_low_neighbor[i];
+			size_t high_idx = xs_high_neighbor[i];
 			y_t predicted = render_point(xs[low_idx], final_ys[low_idx], xs[high_idx], final_ys[high_idx], xs[i]);
 			y_t val = ys[i];
 			CHECK(predicted <= range);
 			y_t high_room = range - predicted;
 			y_t low_room = predicted;
 			y_t room = std::min(high_room, low_room) * 2;
+			step2_flag[i] = false; // might be set later, by a following x with this as neighbor
 			if(val == 0) {
-				step2_flag[i] = false;
 				final_ys[i] = predicted;
 			} else {
 				step2_flag[low_idx] = true;
@@ -557,38 +975,80 @@ struct VorbisFloor1 {
 				}
 			}
 		}
-		push_data_u32(this, "floor1 final_ys", -1, &final_ys[0], final_ys.size());
-		push_data_bool(this, "floor1 step2_flag", -1, step2_flag);
+		push_data_u32(debug_ref, "floor1 final_ys", -1, final_ys.begin(), final_ys.size());
+		push_data_bool(debug_ref, "floor1 step2_flag", -1, step2_flag.begin(), step2_flag.size());
 
 		// Step 2: curve synthesis (7.2.4)
-		// Need sorted xs, final_ys, step2_flag, ascending by the values in xs.
-		// We have prepared xs_sorted_idx for that.
-		std::vector<y_t> final_ys_sorted(xs.size());
-		std::vector<bool> step2_flag_sorted(xs.size());
-		for(size_t i = 0; i < xs.size(); ++i)
-			final_ys_sorted[i] = final_ys[xs_sorted_idx[i]];
-		for(size_t i = 0; i < xs.size(); ++i)
-			step2_flag_sorted[i] = step2_flag[xs_sorted_idx[i]];
+		// Need xs, final_ys, step2_flag, ascending by the values in xs.
+		// We have prepared the permutation xs_sorted_idx for that.
+		// The lines directly give the final amplitudes, out[x] = inverse_db_table[y], see render_line_db.
+		if(want_data(debug_ref, "floor1 floor")) {
+			// The y values, as before over the full window size (out is only half of it).
+			DataRange<y_t> floor = scratch.alloc<y_t>(out.size() * 2);
+			CHECK_ERR(_render_lines(final_ys, step2_flag, floor, render_line<y_t, DataRange<y_t>>));
+			push_data_u32(debug_ref, "floor1 floor", -1, floor.begin(), floor.size());
+		}
+		CHECK_ERR(_render_lines(final_ys, step2_flag, out, render_line_db));
+		return OkOrError();
+	}
+
+	// Step 2: curve synthesis (7.2.4)
+	// Need xs, final_ys, step2_flag, ascending by the values in xs.
+	// We have prepared the permutation xs_sorted_idx for that.
+	template<typename Vec, typename RenderFunc>
+	OkOrError _render_lines(const DataRange<uint32_t>& final_ys, const DataRange<bool>& step2_flag, Vec& out, RenderFunc render) const {
+		typedef uint32_t y_t;
 		x_t lx = 0, hx = 0;
-		y_t ly = final_ys_sorted[0] * multiplier, hy = 0;
-		std::vector<y_t> floor(out.size());
+		y_t ly = final_ys[xs_sorted_idx[0]] * multiplier, hy = 0;
 		for(size_t i = 1; i < xs.size(); ++i) {
-			if(step2_flag_sorted[i]) {
+			size_t idx = xs_sorted_idx[i];
+			if(step2_flag[idx]) {
 				hx = xs_sorted[i];
-				hy = final_ys_sorted[i] * multiplier;
-				render_line(lx, ly, hx, hy, floor);
+				hy = final_ys[idx] * multiplier;
+				CHECK(ly < 256 && hy < 256); // inverse_db_table len. The line is in between.
+				render(lx, ly, hx, hy, out);
 				lx = hx; ly = hy;
 			}
 		}
 		if(hx < out.size())
-			render_line(hx, hy, out.size(), hy, floor);
-		push_data_u32(this, "floor1 floor", -1, &floor[0], floor.size());
-		for(uint16_t i = 0; i < out.size(); ++i) {
-			CHECK(floor[i] < 256); // inverse_db_table len
-			out[i] = inverse_db_table[floor[i]];
-		}
+			render(hx, hy, out.size(), hy, out);
 		return OkOrError();
 	}
+
+	// Like render_line (9.2.7) with the same integer steps, but assigns out[x] = inverse_db_table[y],
+	// i.e. the final floor curve (7.2.4 step 2). Flat lines (also the end) are just a fill.
+	// Expects y0, y1 < 256.
+	static void render_line_db(size_t x0, uint32_t y0, size_t x1, uint32_t y1, DataRange<float>& out) {
+		assert(x0 < x1);
+		if(x0 >= out.size())
+			return;
+		size_t end = std::min(x1, out.size());
+		float* ptr = out.begin();
+		if(y0 == y1) {
+			std::fill(ptr + x0, ptr + end, inverse_db_table[y0]);
+			return;
+		}
+		uint32_t abs_dx = uint32_t(x1 - x0);
+		bool dy_positive = y1 > y0;
+		uint32_t abs_dy = dy_positive ? (y1 - y0) : (y0 - y1);
+		uint32_t abs_base = abs_dy / abs_dx;
+		int32_t base = dy_positive ? int32_t(abs_base) : -int32_t(abs_base);
+		int32_t sy = dy_positive ? int32_t(abs_base + 1) : -int32_t(abs_base + 1);
+		abs_dy -= abs_base * abs_dx;
+		uint32_t abs_err = 0;
+		int32_t y = int32_t(y0);
+		ptr[x0] = inverse_db_table[y];
+		for(size_t x = x0 + 1; x < end; ++x) {
+			abs_err += abs_dy;
+			if(abs_err >= abs_dx) {
+				abs_err -= abs_dx;
+				y += sy;
+			}
+			else
+				y += base;
+			ptr[x] = inverse_db_table[y];
+		}
+	}
 };
 
 struct VorbisFloor {
@@ -596,10 +1056,10 @@ struct VorbisFloor {
 	VorbisFloor0 floor0;
 	VorbisFloor1 floor1;
 
-	OkOrError parse(BitReader& reader, int num_codebooks) {
+	OkOrError parse(PacketBitReader& reader, const std::vector<VorbisCodebook>& codebooks, const VorbisIdHeader& header) {
 		floor_type = reader.readBitsT<16>();
 		if(floor_type == 0)
-			CHECK_ERR(floor0.parse(reader, num_codebooks));
+			CHECK_ERR(floor0.parse(reader, codebooks, header));
 		else if(floor_type == 1)
 			CHECK_ERR(floor1.parse(reader));
 		else
@@ -607,12 +1067,12 @@ struct VorbisFloor {
 		return OkOrError();
 	}
 
-	OkOrError decode(BitReader& reader, const std::vector<VorbisCodebook>& codebooks, DataRange<float>& out, bool& use_output) const {
+	OkOrError decode(PacketBitReader& reader, const std::vector<VorbisCodebook>& codebooks, DataRange<float>& out, bool& use_output, ScratchArena& scratch, const void* debug_ref) const {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 4.3.2
 		if(floor_type == 0)
-			CHECK_ERR(floor0.decode(reader, codebooks, out, use_output));
+			CHECK_ERR(floor0.decode(reader, codebooks, out, use_output, scratch, debug_ref));
 		else if(floor_type == 1)
-			CHECK_ERR(floor1.decode(reader, codebooks, out, use_output));
+			CHECK_ERR(floor1.decode(reader, codebooks, out, use_output, scratch, debug_ref));
 		else
 			CHECK(false); // invalid floor type
 		return OkOrError();
@@ -629,7 +1089,7 @@ struct VorbisResidue {
 	typedef uint8_t book_t;
 	std::vector<book_t> books;
 
-	OkOrError parse(BitReader& reader) {
+	OkOrError parse(PacketBitReader& reader) {
 		type = reader.readBitsT<16>();
 		CHECK(type <= 2);
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 8.6.1. header decode
@@ -667,7 +1127,9 @@ struct VorbisResidue {
 		return decode_len;
 	}
 
-	OkOrError decode(BitReader& reader, const std::vector<VorbisCodebook>& codebooks, uint8_t num_channel, const std::vector<bool>& channel_used, uint32_t decode_len, std::vector<std::vector<float>>& out, int type=-1) const {
+	// out[i] for i < num_channel must be zero-initialized, with size decode_len.
+	// The temporary buffers are from scratch (see VorbisStreamDecodeState::scratch).
+	OkOrError decode(PacketBitReader& reader, const std::vector<VorbisCodebook>& codebooks, uint8_t num_channel, const bool* channel_used, uint32_t decode_len, DataRange<float>* out, ScratchArena& scratch, int type=-1) const {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 4.3.4. residue decode
 		// 8.6.2. packet decode
 		// https://github.com/runningwild/gorbis/blob/master/vorbis/residue.go
@@ -678,18 +1140,16 @@ struct VorbisResidue {
 			type = this->type;
 		CHECK(type >= 0 && type <= 2);
 		CHECK(num_channel > 0);
-		CHECK(channel_used.size() == num_channel);
-		CHECK(out.size() == num_channel);
 		for(uint8_t i = 0; i < num_channel; ++i)
 			CHECK(out[i].size() == decode_len);
 		if(type == 2) {
-			std::vector<std::vector<float>> tmp_out(1);
-			tmp_out[0].resize(num_channel * decode_len, 0);
-			std::vector<bool> tmp_channel_used{true};
-			CHECK_ERR(decode(reader, codebooks, 1, tmp_channel_used, num_channel * decode_len, tmp_out, 1));
+			DataRange<float> tmp_out = scratch.alloc<float>(num_channel * decode_len);
+			std::fill(tmp_out.begin(), tmp_out.end(), 0.f);
+			bool tmp_channel_used = true;
+			CHECK_ERR(decode(reader, codebooks, 1, &tmp_channel_used, num_channel * decode_len, &tmp_out, scratch, 1));
 			for(uint8_t j = 0; j < num_channel; ++j)
 				for(uint32_t i = 0; i < decode_len; ++i)
-					out[j][i] = tmp_out[0][j + num_channel * i];
+					out[j][i] = tmp_out[j + num_channel * i];
 			return OkOrError();
 		}
 		CHECK(type == 0 || type == 1);
@@ -707,7 +1167,7 @@ struct VorbisResidue {
 
 		uint32_t classification_count_per_channel = partitions_to_read + classwords_per_codeword;
 		typedef uint8_t classification_t;
-		std::vector<classification_t> classifications(num_channel * classification_count_per_channel);
+		DataRange<classification_t> classifications = scratch.alloc<classification_t>(num_channel * classification_count_per_channel);
 		for(uint8_t pass = 0; pass < 8; ++pass) {
 			uint32_t partition_count = 0;
 			while(partition_count < partitions_to_read) {
@@ -729,7 +1189,7 @@ struct VorbisResidue {
 							uint8_t vq_book = books[uint16_t(vq_class) * 8 + pass];
 							if(vq_book != book_t(-1)) {
 								const VorbisCodebook& vq_codebook = codebooks[vq_book];
-								std::vector<float>& v = out[j];
+								DataRange<float>& v = out[j];
 								uint32_t offset = limit_begin + partition_count * partition_size;
 								if(type == 0) {
 									// 8.6.3. format 0 specifics
@@ -753,8 +1213,8 @@ struct VorbisResidue {
 								else CHECK(false); // invalid type
 							}
 						}
-						++partition_count;
 					}
+					++partition_count; // once for all channels
 				}
 			}
 		}
@@ -770,7 +1230,7 @@ struct VorbisMapping {
 	struct Submap { uint8_t floor, residue; };
 	std::vector<Submap> submaps;
 
-	OkOrError parse(BitReader& reader, int num_channels, int num_floors, int num_residues) {
+	OkOrError parse(PacketBitReader& reader, int num_channels, int num_floors, int num_residues) {
 		CHECK(num_channels > 0);
 		int bits = highest_bit(num_channels - 1);
 		type = reader.readBitsT<16>();
@@ -813,6 +1273,13 @@ struct VorbisMapping {
 	}
 };
 
+struct VorbisWindowSlopes {
+	// The window is 0 in [0, left_begin), rising in [left_begin, left_end), 1 in [left_end, right_begin),
+	// falling in [right_begin, right_end) and 0 in [right_end, blocksize).
+	uint16_t left_begin, left_end;
+	uint16_t right_begin, right_end;
+};
+
 struct VorbisModeNumber { // used in VorbisStreamSetup
 	bool block_flag; // == long window
 	uint16_t window_type;
@@ -821,8 +1288,9 @@ struct VorbisModeNumber { // used in VorbisStreamSetup
 	// precalculated
 	uint16_t blocksize;
 	std::vector<float> windows;
+	VorbisWindowSlopes window_slopes[4];
 
-	OkOrError parse(BitReader& reader, int num_mappings, VorbisIdHeader& header) {
+	OkOrError parse(PacketBitReader& reader, int num_mappings, VorbisIdHeader& header) {
 		block_flag = reader.readBitsT<1>();
 		window_type = reader.readBitsT<16>();
 		CHECK(window_type == 0);
@@ -847,6 +1315,11 @@ struct VorbisModeNumber { // used in VorbisStreamSetup
 			uint16_t right = (next ? blocksize1 : blocksize0) / 2;
 			uint16_t left_begin = blocksize / 4 - left / 2;
 			uint16_t right_begin = blocksize - blocksize / 4 - right / 2;
+			VorbisWindowSlopes& slopes = window_slopes[win_idx];
+			slopes.left_begin = left_begin;
+			slopes.left_end = left_begin + left;
+			slopes.right_begin = right_begin;
+			slopes.right_end = right_begin + right;
 			for(int i = 0; i < left; ++i) {
 				float x = sinf(M_PI_2 * (i + 0.5) / left);
 				window[left_begin + i] = sinf(M_PI_2 * x * x);
@@ -871,7 +1344,7 @@ struct VorbisModeNumber { // used in VorbisStreamSetup
 		return DataRange<const float>(&windows[idx * blocksize], blocksize);
 	}
 
-	DataRange<const float> getWindow(bool prev, bool next) const {
+	static int _getWindowIdx(bool block_flag, bool prev, bool next) {
 		int win_idx = 0;
 		if(block_flag) {
 			if(next) {
@@ -882,7 +1355,15 @@ struct VorbisModeNumber { // used in VorbisStreamSetup
 				win_idx = 1;
 			}
 		}
-		return _getWindow(win_idx);
+		return win_idx;
+	}
+
+	DataRange<const float> getWindow(bool prev, bool next) const {
+		return _getWindow(_getWindowIdx(block_flag, prev, next));
+	}
+
+	const VorbisWindowSlopes& getWindowSlopes(bool prev, bool next) const {
+		return window_slopes[_getWindowIdx(block_flag, prev, next)];
 	}
 };
 
@@ -893,8 +1374,10 @@ struct VorbisStreamSetup { // used in VorbisStream
 	std::vector<VorbisResidue> residues;
 	std::vector<VorbisMapping> mappings;
 	std::vector<VorbisModeNumber> modes;
+	// precalculated
+	Mdct mdct[2]; // for blocksize 0 and 1
 
-	OkOrError parse(BitReader& reader, VorbisIdHeader& header) {
+	OkOrError parse(PacketBitReader& reader, VorbisIdHeader& header) {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 4.2.4
 		// https://github.com/ioctlLR/NVorbis/blob/master/NVorbis/VorbisStreamDecoder.cs LoadBooks
 		// https://github.com/runningwild/gorbis/blob/master/vorbis/setup_header.go
@@ -923,7 +1406,7 @@ struct VorbisStreamSetup { // used in VorbisStream
 			int count = reader.readBitsT<6>() + 1;
 			floors.resize(count);
 			for(int i = 0; i < count; ++i)
-				CHECK_ERR(floors[i].parse(reader, (int)codebooks.size()));
+				CHECK_ERR(floors[i].parse(reader, codebooks, header));
 			CHECK(!reader.reachedEnd());
 		}
 
@@ -959,10 +1442,121 @@ struct VorbisStreamSetup { // used in VorbisStream
 		// Check that we are at the end now.
 		CHECK(reader.readBitsT<8>() == 0);
 		CHECK(reader.reachedEnd());
+
+		mdct[0].init(header.get_blocksize_0());
+		mdct[1].init(header.get_blocksize_1());
 		return OkOrError();
 	}
 };
 
+struct VorbisDecoderContext; // see below. The cache only keeps references.
+
+struct VorbisDecoderContextCache {
+	// Process-wide cache of decoder contexts, which are immutable and shared by reference.
+	// Files from the same encoder (version and settings) usually have identical id and setup headers,
+	// so this saves us the codebook/VQ/window/MDCT init for every new stream.
+	// Thread-safe.
+	// The setup parsing and the context only depend on these fields of the id header,
+	// so e.g. files which only differ in the bitrate fields share the context.
+	struct HeaderKey {
+		uint8_t audio_channels;
+		uint8_t blocksizes_exp;
+		explicit HeaderKey(const VorbisIdHeader& header) : audio_channels(header.audio_channels), blocksizes_exp(header.blocksizes_exp) {}
+		bool operator==(const HeaderKey& other) const { return audio_channels == other.audio_channels && blocksizes_exp == other.blocksizes_exp; }
+	};
+	struct Entry {
+		std::vector<uint8_t> setup_packet; // we compare it on lookup, to be safe against hash collisions
+		HeaderKey header;
+		explicit Entry(const HeaderKey& key) : header(key), last_used(0) {}
+		std::shared_ptr<const VorbisDecoderContext> context;
+		uint64_t last_used;
+	};
+	std::mutex mutex_;
+	std::multimap<uint64_t, Entry> entries_; // by _hash()
+	size_t max_entries_;
+	uint64_t use_counter_;
+
+	VorbisDecoderContextCache() : max_entries_(16), use_counter_(0) {}
+
+	static VorbisDecoderContextCache& instance() {
+		static VorbisDecoderContextCache cache;
+		return cache;
+	}
+
+	// 0 disables the cache.
+	void set_max_entries(size_t max_entries) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		max_entries_ = max_entries;
+		_evict();
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		entries_.clear();
+	}
+
+	static uint64_t _hash(const HeaderKey& header, const uint8_t* data, size_t data_len) {
+		uint64_t h = hash_fnv1a(data, data_len);
+		h = hash_fnv1a(&header.audio_channels, 1, h);
+		return hash_fnv1a(&header.blocksizes_exp, 1, h);
+	}
+
+	static bool _matches(const Entry& entry, const HeaderKey& header, const uint8_t* data, size_t data_len) {
+		return
+			entry.header == header &&
+			entry.setup_packet.size() == data_len &&
+			memcmp(entry.setup_packet.data(), data, data_len) == 0;
+	}
+
+	// Returns null if not found.
+	std::shared_ptr<const VorbisDecoderContext> find(const VorbisIdHeader& id_header, const uint8_t* data, size_t data_len) {
+		HeaderKey header(id_header);
+		uint64_t h = _hash(header, data, data_len);
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto range = entries_.equal_range(h);
+		for(auto it = range.first; it != range.second; ++it) {
+			if(_matches(it->second, header, data, data_len)) {
+				it->second.last_used = ++use_counter_;
+				return it->second.context;
+			}
+		}
+		return nullptr;
+	}
+
+	// Returns the cached setup, which might be a different instance if another thread was faster.
+	std::shared_ptr<const VorbisDecoderContext> insert(const VorbisIdHeader& id_header, const uint8_t* data, size_t data_len, const std::shared_ptr<const VorbisDecoderContext>& context) {
+		HeaderKey header(id_header);
+		uint64_t h = _hash(header, data, data_len);
+		std::lock_guard<std::mutex> lock(mutex_);
+		if(max_entries_ == 0)
+			return context;
+		auto range = entries_.equal_range(h);
+		for(auto it = range.first; it != range.second; ++it) {
+			if(_matches(it->second, header, data, data_len)) {
+				it->second.last_used = ++use_counter_;
+				return it->second.context;
+			}
+		}
+		Entry entry(header);
+		entry.setup_packet.assign(data, data + data_len);
+		entry.context = context;
+		entry.last_used = ++use_counter_;
+		entries_.insert(std::make_pair(h, entry));
+		_evict();
+		return context;
+	}
+
+	void _evict() { // Expects that we hold the lock.
+		while(entries_.size() > max_entries_) {
+			auto oldest = entries_.begin();
+			for(auto it = entries_.begin(); it != entries_.end(); ++it)
+				if(it->second.last_used < oldest->second.last_used)
+					oldest = it;
+			entries_.erase(oldest);
+		}
+	}
+};
+
 struct ParseCallbacks {
 	// Returning false means to stop.
 	virtual bool gotHeader(const VorbisIdHeader& header) { (void) header; return true; }
@@ -972,6 +1566,85 @@ struct ParseCallbacks {
 	virtual bool gotEof() { return true; }
 };
 
+enum PcmFormat {
+	PcmFormat_Float32 = 0,
+	PcmFormat_Int16 = 1,
+	PcmFormat_Int24 = 2, // in int32, right-aligned, i.e. in [-2^23, 2^23)
+};
+
+struct InterleavedPcmSink : ParseCallbacks {
+	// Writes the PCM interleaved into a caller-provided buffer, converted to the format.
+	// The int formats are saturated, and optionally get TPDF dither (see SimdDither).
+	// The channelPcms in gotPcmData point directly into the overlap/add buffer,
+	// thus every sample is read once and written once.
+	PcmFormat format;
+	bool dither;
+	uint8_t* buffer;
+	size_t buffer_frames; // capacity
+	size_t num_frames; // written so far, since the last clear()
+	uint8_t num_channels;
+	SimdDither dither_state;
+
+	InterleavedPcmSink(PcmFormat format_, void* buffer_, size_t buffer_frames_, bool dither_ = false)
+	: format(format_), dither(dither_), buffer((uint8_t*) buffer_), buffer_frames(buffer_frames_),
+	num_frames(0), num_channels(0) {}
+
+	static size_t sampleSize(PcmFormat format) {
+		return (format == PcmFormat_Int16) ? 2 : 4;
+	}
+
+	size_t frameSize() const { return sampleSize(format) * num_channels; }
+
+	// Start again from the beginning of the buffer.
+	void clear() { num_frames = 0; }
+
+	// Called when the buffer is full and there is more PCM.
+	// The default fails, i.e. the buffer must be big enough for everything.
+	// Override to consume the buffer, call clear() and return true.
+	virtual bool bufferFull() { return false; }
+
+	virtual bool gotHeader(const VorbisIdHeader& header) {
+		num_channels = header.audio_channels;
+		return true;
+	}
+
+	virtual bool gotPcmData(const std::vector<DataRange<const float>>& channelPcms) {
+		if(channelPcms.size() != num_channels || num_channels == 0) return false;
+		size_t len = channelPcms[0].size();
+		size_t pos = 0;
+		while(pos < len) {
+			if(num_frames >= buffer_frames) {
+				if(!bufferFull()) return false;
+				if(num_frames >= buffer_frames) return false;
+			}
+			size_t n = std::min(len - pos, buffer_frames - num_frames);
+			for(uint8_t c = 0; c < num_channels; ++c)
+				_write(c, channelPcms[c].begin() + pos, n);
+			num_frames += n;
+			pos += n;
+		}
+		return true;
+	}
+
+	void _write(uint8_t channel, const float* src, size_t n) {
+		size_t offset = num_frames * num_channels + channel;
+		switch(format) {
+			case PcmFormat_Float32: {
+				float* dst = (float*) buffer + offset;
+				for(size_t i = 0; i < n; ++i)
+					dst[i * num_channels] = src[i];
+				break;
+			}
+			case PcmFormat_Int16:
+				simd_float_to_int16((int16_t*) buffer + offset, num_channels, src, n, dither ? &dither_state : nullptr);
+				break;
+			case PcmFormat_Int24:
+				simd_float_to_int24((int32_t*) buffer + offset, num_channels, src, n, dither ? &dither_state : nullptr);
+				break;
+		}
+	}
+};
+
 struct VorbisStreamDecodeState {
 	// https://xiph.org/vorbis/doc/Vorbis_I_spec.html
 	// 1.3.2. Decode Procedure
@@ -980,49 +1653,171 @@ struct VorbisStreamDecodeState {
 	// amount: window_blocksize(previous_window)/4+window_blocksize(current_window)/4
 	// Data is not returned from the first frame
 
-	std::vector<std::vector<float>> pcm_buffer; // for each channel
-	uint32_t pcm_offset; // where to start writing next
-	int16_t prev_second_half_window_offset; // offset to pcm_offset. can be negative
+	// For each channel, a ring buffer of ring_size (power of two) frames.
+	// The positions below are absolute frame positions modulo 2^32, the index in the ring is pos & ring_mask.
+	// Everything from written_end on (up to the live data, ring_size ahead) is zero,
+	// so a new frame is just added (overlap-add) in [pcm_offset, pcm_offset + cur_win_size).
+	// The live data is from the center of the previous frame up to the end of the current frame,
+	// which is at most blocksize_1 frames (prev/4 + cur*3/4), so ring_size = 2 * blocksize_1 is enough.
+	std::vector<std::vector<float>> pcm_buffer;
+	uint32_t ring_size, ring_mask;
+	uint32_t pcm_offset; // start of the current frame
+	uint32_t written_end; // see above
+	int32_t prev_second_half_window_offset; // offset to pcm_offset. can be negative
 	uint32_t prev_win_size, cur_win_size;
 	uint64_t abs_total_pos; // number of samples so far returned
 	int64_t expected_ending_total_pos; // expected abs_total_pos after this audio frame
+	uint64_t skip_until_pos; // PCM before this abs pos is not forwarded to the callbacks (e.g. after a seek)
+	uint64_t stop_at_pos; // PCM from this abs pos on is not forwarded to the callbacks
+	// If set, audio packets are not decoded. Only their window sizes and the position are tracked,
+	// until we get close to skip_until_pos. See skipAudioPacket().
+	bool skip_packets;
+	// All temporary buffers of the audio packet decode, reset for every packet.
+	// Reserved in VorbisDecoderContext::init_decode_state, so there are no heap allocations per packet.
+	ScratchArena scratch;
+	std::vector<DataRange<const float>> channel_pcms; // for forwardReadyPcm
+	// From this number of channels on, the inverse MDCT runs in batches of 4 channels (Mdct::backward_x4).
+	// See OggReader::set_batch_mdct_min_channels.
+	uint8_t batch_mdct_min_channels;
 
 	VorbisStreamDecodeState() :
-	pcm_offset(0), prev_second_half_window_offset(0),
+	ring_size(0), ring_mask(0),
+	pcm_offset(0), written_end(0), prev_second_half_window_offset(0),
 	prev_win_size(0), cur_win_size(0),
-	abs_total_pos(0), expected_ending_total_pos(0) {}
+	abs_total_pos(0), expected_ending_total_pos(0),
+	skip_until_pos(0), stop_at_pos(UINT64_MAX), skip_packets(false), batch_mdct_min_channels(4) {}
 
-	void init(uint8_t num_channels, uint32_t pcm_buffer_size) {
+	void init(uint8_t num_channels, uint32_t ring_size_) {
+		assert(ring_size_ > 0 && (ring_size_ & (ring_size_ - 1)) == 0);
+		ring_size = ring_size_;
+		ring_mask = ring_size_ - 1;
 		pcm_buffer.resize(num_channels);
-		size_t capacity = 0;
-		for(uint8_t i = 0; i < num_channels; ++i) {
-			pcm_buffer[i].resize(pcm_buffer_size);
-			if(pcm_buffer[i].capacity() > capacity)
-				capacity = pcm_buffer[i].capacity();
-		}
-		// Just use the full capacity. It does not make much sense to not use it.
 		for(uint8_t i = 0; i < num_channels; ++i)
-			pcm_buffer[i].resize(capacity);
+			pcm_buffer[i].assign(ring_size, 0.f);
+		pcm_offset = written_end = 0;
+		channel_pcms.resize(num_channels);
+	}
+
+	// Like the start of a stream, but the next audio frame (which returns no data) ends at abs_pos.
+	// Used after a seek.
+	void reset(uint64_t abs_pos) {
+		for(std::vector<float>& channel_pcm : pcm_buffer)
+			std::fill(channel_pcm.begin(), channel_pcm.end(), 0.f);
+		pcm_offset = written_end = 0;
+		prev_second_half_window_offset = 0;
+		prev_win_size = cur_win_size = 0;
+		abs_total_pos = abs_pos;
+	}
+
+	// Calls f(ring_idx, i, len) for the (at most two) contiguous parts of the n frames starting at pos,
+	// where i is the offset into the n frames.
+	template<typename F>
+	void _forRingSpans(uint32_t pos, uint32_t n, F f) const {
+		uint32_t idx = pos & ring_mask;
+		uint32_t n1 = std::min(n, ring_size - idx);
+		if(n1 > 0) f(idx, uint32_t(0), n1);
+		if(n > n1) f(uint32_t(0), n1, n - n1);
+	}
+
+	// Next audio packets will be skipped (see skipAudioPacket), like at the start of the stream,
+	// i.e. the position is given by the expected ending pos of the next page.
+	void startSkipping() {
+		skip_packets = true;
+		prev_win_size = cur_win_size = 0;
 	}
 
-	OkOrError addPcmFrame(uint8_t channel, DataRange<const float> new_pcm, DataRange<const float> window) {
+	// Called for each audio packet instead of the decoding, if skip_packets.
+	// Sets decode if we need to decode this packet.
+	// In that case, it is the first frame (returning no data) for the following packets.
+	OkOrError skipAudioPacket(uint32_t win_size, uint32_t max_win_size, bool& decode) {
+		assert(skip_packets);
+		uint64_t pos = abs_total_pos;
+		if(cur_win_size > 0) {
+			pos += cur_win_size / 4 + win_size / 4;
+			if(expected_ending_total_pos >= 0) {
+				// Like in forwardReadyPcm, the data might be shortened (only at the beginning or end of the stream).
+				CHECK(pos >= uint64_t(expected_ending_total_pos));
+				pos = uint64_t(expected_ending_total_pos);
+			}
+		}
+		else if(expected_ending_total_pos >= 0) // first packet after startSkipping, e.g. after a seek
+			pos = uint64_t(expected_ending_total_pos);
+		// The next packet returns [pos, pos + win_size / 4 + next_win_size / 4).
+		if(pos + win_size / 4 + max_win_size / 4 > skip_until_pos) {
+			skip_packets = false;
+			reset(pos);
+			decode = true;
+		}
+		else {
+			abs_total_pos = pos;
+			cur_win_size = win_size;
+			decode = false;
+		}
+		return OkOrError();
+	}
+
+	OkOrError addPcmFrame(
+		uint8_t channel, DataRange<const float> new_pcm,
+		DataRange<const float> window, const VorbisWindowSlopes& slopes
+	) {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html
 		// 1.3.2. Decode Procedure
 		CHECK(channel < pcm_buffer.size());
 		CHECK(new_pcm.size() == window.size());
-		CHECK(pcm_offset + window.size() <= pcm_buffer[channel].size());
-		for(uint32_t i = 0; i < new_pcm.size(); ++i)
-			pcm_buffer[channel][pcm_offset + i] += new_pcm[i] * window[i];
+		CHECK(window.size() == cur_win_size);
+		CHECK(slopes.right_end <= window.size());
+		// Only the slopes need the multiplication. Where the window is 1, new_pcm[i] * 1 == new_pcm[i] exactly,
+		// and where it is 0, the buffer stays as it is. So this is exactly the same as the plain loop over the window.
+		float* buf = pcm_buffer[channel].data();
+		const float* pcm = new_pcm.begin();
+		const float* win = window.begin();
+		_forRingSpans(pcm_offset + slopes.left_begin, slopes.left_end - slopes.left_begin, [&](uint32_t idx, uint32_t i, uint32_t n) {
+			simd_mul_add(buf + idx, pcm + slopes.left_begin + i, win + slopes.left_begin + i, n);
+		});
+		_forRingSpans(pcm_offset + slopes.left_end, slopes.right_begin - slopes.left_end, [&](uint32_t idx, uint32_t i, uint32_t n) {
+			simd_add(buf + idx, pcm + slopes.left_end + i, n);
+		});
+		_forRingSpans(pcm_offset + slopes.right_begin, slopes.right_end - slopes.right_begin, [&](uint32_t idx, uint32_t i, uint32_t n) {
+			simd_mul_add(buf + idx, pcm + slopes.right_begin + i, win + slopes.right_begin + i, n);
+		});
+		return OkOrError();
+	}
+
+	// Like addPcmFrame, for num_channels (<= 4) channels from first_channel on,
+	// from the interleaved output of Mdct::backward_x4 (new_pcm4[i * 4 + c]).
+	OkOrError addPcmFrames_x4(
+		uint8_t first_channel, uint8_t num_channels, DataRange<const float> new_pcm4,
+		DataRange<const float> window, const VorbisWindowSlopes& slopes
+	) {
+		CHECK(num_channels <= 4 && size_t(first_channel) + num_channels <= pcm_buffer.size());
+		CHECK(new_pcm4.size() == window.size() * 4);
+		CHECK(window.size() == cur_win_size);
+		CHECK(slopes.right_end <= window.size());
+		const float* pcm4 = new_pcm4.begin();
+		const float* win = window.begin();
+		float* bufs[4];
+		auto spanBufs = [&](uint32_t idx) {
+			for(uint8_t c = 0; c < num_channels; ++c)
+				bufs[c] = pcm_buffer[first_channel + c].data() + idx;
+			return bufs;
+		};
+		_forRingSpans(pcm_offset + slopes.left_begin, slopes.left_end - slopes.left_begin, [&](uint32_t idx, uint32_t i, uint32_t n) {
+			simd_mul_add_x4(spanBufs(idx), num_channels, pcm4 + (slopes.left_begin + i) * 4, win + slopes.left_begin + i, n);
+		});
+		_forRingSpans(pcm_offset + slopes.left_end, slopes.right_begin - slopes.left_end, [&](uint32_t idx, uint32_t i, uint32_t n) {
+			simd_add_x4(spanBufs(idx), num_channels, pcm4 + (slopes.left_end + i) * 4, n);
+		});
+		_forRingSpans(pcm_offset + slopes.right_begin, slopes.right_end - slopes.right_begin, [&](uint32_t idx, uint32_t i, uint32_t n) {
+			simd_mul_add_x4(spanBufs(idx), num_channels, pcm4 + (slopes.right_begin + i) * 4, win + slopes.right_begin + i, n);
+		});
 		return OkOrError();
 	}
 
 	OkOrError forwardReadyPcm(ParseCallbacks& callbacks) {
 		uint32_t num_frames = 0;
 		if(prev_win_size > 0) {
-			uint32_t pcm_cur_second_half_window_offset = pcm_offset + cur_win_size / 2;
-			uint32_t pcm_prev_second_half_window_offset = pcm_offset + prev_second_half_window_offset;
-			CHECK(pcm_prev_second_half_window_offset < pcm_cur_second_half_window_offset);
-			num_frames = pcm_cur_second_half_window_offset - pcm_prev_second_half_window_offset;
+			CHECK(prev_second_half_window_offset < int32_t(cur_win_size / 2));
+			num_frames = uint32_t(int32_t(cur_win_size / 2) - prev_second_half_window_offset);
 			CHECK(num_frames == prev_win_size / 4 + cur_win_size / 4);
 		}
 		if(expected_ending_total_pos >= 0) {
@@ -1043,14 +1838,26 @@ struct VorbisStreamDecodeState {
 			}
 		}
 		if(num_frames > 0) {
-			uint8_t num_channels = pcm_buffer.size();
-			std::vector<DataRange<const float>> channelPcms(num_channels);
-			for(uint8_t channel = 0; channel < num_channels; ++channel) {
-				channelPcms[channel] =
-					DataRange<const float>(&pcm_buffer[channel][pcm_offset + prev_second_half_window_offset], num_frames);
-				push_data_float(this, "pcm", channel, channelPcms[channel].begin(), channelPcms[channel].size());
+			// Trim to [skip_until_pos, stop_at_pos).
+			uint32_t skip_frames = 0, end_frames = num_frames;
+			if(abs_total_pos < skip_until_pos)
+				skip_frames = uint32_t(std::min(uint64_t(num_frames), skip_until_pos - abs_total_pos));
+			if(abs_total_pos + num_frames > stop_at_pos)
+				end_frames = uint32_t(std::max(stop_at_pos, abs_total_pos) - abs_total_pos);
+			if(skip_frames < end_frames) {
+				// If it wraps around in the ring, this goes out in two parts.
+				uint8_t num_channels = pcm_buffer.size();
+				std::vector<DataRange<const float>>& channelPcms = channel_pcms;
+				bool ok = true;
+				_forRingSpans(pcm_offset + prev_second_half_window_offset + skip_frames, end_frames - skip_frames, [&](uint32_t idx, uint32_t, uint32_t n) {
+					for(uint8_t channel = 0; channel < num_channels; ++channel) {
+						channelPcms[channel] = DataRange<const float>(&pcm_buffer[channel][idx], n);
+						push_data_float(this, "pcm", channel, channelPcms[channel].begin(), channelPcms[channel].size());
+					}
+					if(ok) ok = callbacks.gotPcmData(channelPcms);
+				});
+				CHECK(ok);
 			}
-			CHECK(callbacks.gotPcmData(channelPcms));
 			abs_total_pos += num_frames;
 		}
 		if(expected_ending_total_pos >= 0)
@@ -1059,52 +1866,29 @@ struct VorbisStreamDecodeState {
 	}
 
 	OkOrError advancePcmOffsetBeginAudioPacket(uint32_t cur_win_size) {
+		CHECK(cur_win_size <= ring_size / 2);
 		if(this->cur_win_size > 0) // prev win size
 			CHECK_ERR(_advancePcmOffset(cur_win_size));
 		prev_win_size = this->cur_win_size;
 		this->cur_win_size = cur_win_size;
+		// Clear the stale data (ring_size frames ago) where the new frame goes beyond what we have written so far.
+		uint32_t end = pcm_offset + cur_win_size;
+		if(int32_t(end - written_end) > 0) {
+			for(std::vector<float>& channel_pcm : pcm_buffer) {
+				_forRingSpans(written_end, end - written_end, [&](uint32_t idx, uint32_t, uint32_t n) {
+					memset(&channel_pcm[idx], 0, n * sizeof(float));
+				});
+			}
+			written_end = end;
+		}
 		return OkOrError();
 	}
 
 	OkOrError _advancePcmOffset(uint32_t next_win_size) {
-		uint8_t num_channels = pcm_buffer.size();
-		uint32_t pcm_cur_second_half_window_offset = pcm_offset + cur_win_size / 2;
-		int32_t next_pcm_offset = int32_t(pcm_offset) + (int32_t(cur_win_size) / 4) * 3 - (int32_t(next_win_size) / 4) * 1;
-		// Check whether we need to move the data to have enough room for the next window.
-		// We need to keep cur_win_size / 2 of the recent frames.
-		if(next_pcm_offset + next_win_size >= pcm_buffer[0].size()) {
-			// Move to the left.
-			// Keep half of the current window.
-			int32_t needed_offset = int32_t(pcm_offset) + cur_win_size / 2 - next_pcm_offset;
-			if(needed_offset < 0)
-				pcm_cur_second_half_window_offset = 0; // No extra space needed.
-			else
-				pcm_cur_second_half_window_offset = needed_offset; // Need extra space.
-			uint32_t delete_start_offset = pcm_cur_second_half_window_offset + cur_win_size / 2;
-			for(uint8_t channel = 0; channel < num_channels; ++channel) {
-				memmove(&pcm_buffer[channel][pcm_cur_second_half_window_offset], &pcm_buffer[channel][pcm_offset + cur_win_size / 2], (cur_win_size / 2) * sizeof(float));
-				memset(&pcm_buffer[channel][delete_start_offset], 0, (pcm_buffer[channel].size() - delete_start_offset) * sizeof(float));
-			}
-			if(needed_offset < 0)
-				// We need to have the cur second half window still available for the next forwardReadyPcm().
-				next_pcm_offset = -needed_offset;
-			else
-				next_pcm_offset = 0;
-		}
-		else if(next_pcm_offset < 0) { // possible if short window and next is long window
-			uint32_t extra_room_needed = uint32_t(-next_pcm_offset);
-			// Move to the right.
-			pcm_cur_second_half_window_offset += extra_room_needed;
-			for(uint8_t channel = 0; channel < num_channels; ++channel) {
-				memmove(&pcm_buffer[channel][pcm_offset + extra_room_needed], &pcm_buffer[channel][pcm_offset], cur_win_size * sizeof(float));
-				memset(&pcm_buffer[channel][0], 0, (pcm_offset + extra_room_needed) * sizeof(float));
-			}
-			next_pcm_offset = 0;
-		}
-		if(next_win_size < cur_win_size)
-			CHECK(next_pcm_offset > 0);
-		prev_second_half_window_offset = int16_t(int32_t(pcm_cur_second_half_window_offset) - int32_t(next_pcm_offset));
-		pcm_offset = next_pcm_offset;
+		// The next frame starts such that its center is at 3/4 of the current frame minus 1/4 of the next frame.
+		// No data is moved, this just advances in the ring.
+		pcm_offset += (cur_win_size / 4) * 3 - (next_win_size / 4);
+		prev_second_half_window_offset = int32_t(next_win_size / 4) - int32_t(cur_win_size / 4);
 		return OkOrError();
 	}
 
@@ -1114,31 +1898,95 @@ struct VorbisStreamDecodeState {
 
 };
 
-struct VorbisStream {
-	VorbisIdHeader header;
-	VorbisStreamSetup setup;
-	uint32_t packet_counts_;
-	uint32_t audio_packet_counts_;
-	VorbisStreamDecodeState decode_state;
-	Mdct mdct[2];
+struct VorbisDecoderContext {
+	// Everything which is needed to decode the audio packets of a stream, and which is read-only after the headers:
+	// The id header, and the setup (codebooks, floors, residues, mappings, modes with their windows, MDCT lookups).
+	// The context is immutable and shared by reference (see VorbisDecoderContextCache),
+	// so any number of VorbisStreamDecodeState instances, also in multiple threads, can use the same context.
+	VorbisIdHeader header; // of the stream which created it. Only the fields in VorbisDecoderContextCache::HeaderKey are used
+	std::shared_ptr<const VorbisStreamSetup> setup;
+
+	void init_decode_state(VorbisStreamDecodeState& state) const {
+		// See VorbisStreamDecodeState, the live data is at most blocksize_1.
+		state.init(header.audio_channels, uint32_t(header.get_blocksize_1()) * 2);
+		state.scratch.reserve(scratch_size(state.batch_mdct_min_channels));
+	}
 
-	VorbisStream() : packet_counts_(0), audio_packet_counts_(0) {}
-	~VorbisStream() { unregister_decoder_ref(this); }
+	// Upper bound of the scratch usage of parse_audio.
+	// Every allocation can use up to ScratchArena::Alignment more, and their number grows with the channels,
+	// thus we count the allocations as well.
+	// See VorbisStreamDecodeState::batch_mdct_min_channels.
+	size_t scratch_size(uint8_t batch_mdct_min_channels) const {
+		assert(setup);
+		size_t channels = header.audio_channels;
+		size_t n = header.get_blocksize_1();
+		size_t size = 0, num_allocs = 0;
+		size += channels * n / 2 * sizeof(float); // floor_outputs
+		size += channels * n / 2 * sizeof(float); // residue_outputs
+		size += channels * (sizeof(bool) * 2 + sizeof(DataRange<float>) * 2); // flags, per-submap out
+		num_allocs += 5 + channels; // floor_outputs, the flags, per-submap out, residue_outputs and one per channel
+		size_t max_floor = 0; // per channel, including the padding
+		for(const VorbisFloor& floor : setup->floors) {
+			if(floor.floor_type == 1) // ys, final_ys, step2 flags (and the floor for the debug output, not counted here)
+				max_floor = std::max(max_floor, floor.floor1.xs.size() * (sizeof(uint32_t) * 2 + sizeof(bool)) + 3 * ScratchArena::Alignment);
+			else if(floor.floor_type == 0)
+				max_floor = std::max(max_floor, floor.floor0.scratch_size());
+		}
+		size += channels * max_floor;
+		size_t max_residues = 0; // including the padding
+		for(const VorbisMapping& mapping : setup->mappings) {
+			size_t residues = 0;
+			for(const VorbisMapping::Submap& submap : mapping.submaps) {
+				const VorbisResidue& residue = setup->residues[submap.residue];
+				size_t len = residue.type == 2 ? channels * n / 2 : n / 2;
+				size_t classwords = residue.classbook < setup->codebooks.size() ? setup->codebooks[residue.classbook].dimensions_ : 0;
+				size_t classifications = (residue.type == 2 ? 1 : channels) * (len / residue.partition_size + classwords);
+				residues += (residue.type == 2 ? len * sizeof(float) + ScratchArena::Alignment : 0) + classifications + ScratchArena::Alignment;
+			}
+			max_residues = std::max(max_residues, residues);
+		}
+		size += max_residues;
+		if(channels >= batch_mdct_min_channels) { // batch_in, batch_out
+			size += (n / 2 * 4 + n * 4) * sizeof(float);
+			num_allocs += 2;
+		}
+		else {
+			size += n * sizeof(float); // pcm
+			num_allocs += 1;
+		}
+		return size + num_allocs * ScratchArena::Alignment;
+	}
 
-	OkOrError parse_audio(BitReader& reader, VorbisStreamDecodeState& state, ParseCallbacks& callbacks) const {
+	// Only reads the packet type and the mode (4.3.1), e.g. to skip the packet without decoding.
+	OkOrError peek_audio_window_size(PacketBitReader& reader, uint32_t& win_size) const {
+		CHECK(this->setup);
+		CHECK(reader.readBitsT<1>() == 0);
+		CHECK(setup->modes.size() > 0);
+		int mode_idx = reader.readBits<uint16_t>(highest_bit(setup->modes.size() - 1));
+		CHECK(size_t(mode_idx) < setup->modes.size());
+		win_size = setup->modes[mode_idx].block_flag ? header.get_blocksize_1() : header.get_blocksize_0();
+		return OkOrError();
+	}
+
+	OkOrError parse_audio(PacketBitReader& reader, VorbisStreamDecodeState& state, ParseCallbacks& callbacks) const {
 		// By design, this is a const function, because we will not modify any of the header or the setup.
 		// However, we will modify the decode state, which remembers things like the PCM position,
 		// and recent decoded PCM, which we need for the windowing.
 		// That is why we pass in the decode state as a writeable ref.
+		// The decode state is also used as the ref for the debug push_data_* calls.
 
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html
 		// 1.3.2. Decode Procedure (very high level)
 		// 4.3 Audio packet decode and synthesis
 		// https://github.com/runningwild/gorbis/blob/master/vorbis/codec.go
 		// https://github.com/ioctlLR/NVorbis/blob/master/NVorbis/VorbisStreamDecoder.cs
-		push_data_u8(this, "start_audio_packet", -1, nullptr, 0);
-		push_data_u64(this, "abs_total_pos", -1, &decode_state.abs_total_pos, 1);
-		push_data_i64(this, "expected_ending_total_pos", -1, &decode_state.expected_ending_total_pos, 1);
+		CHECK(this->setup);
+		const VorbisStreamSetup& setup = *this->setup;
+		ScratchArena& scratch = state.scratch;
+		scratch.reset();
+		push_data_u8(&state, "start_audio_packet", -1, nullptr, 0);
+		push_data_u64(&state, "abs_total_pos", -1, &state.abs_total_pos, 1);
+		push_data_i64(&state, "expected_ending_total_pos", -1, &state.expected_ending_total_pos, 1);
 		CHECK(reader.readBitsT<1>() == 0);
 		CHECK(setup.modes.size() > 0);
 
@@ -1152,23 +2000,25 @@ struct VorbisStream {
 			next_window_flag = reader.readBitsT<1>();
 		}
 		DataRange<const float> window = mode.getWindow(prev_window_flag, next_window_flag);
+		const VorbisWindowSlopes& window_slopes = mode.getWindowSlopes(prev_window_flag, next_window_flag);
 		CHECK((window.size() >> 16) == 0); // window size should fit in uint16_t
 		CHECK_ERR(state.advancePcmOffsetBeginAudioPacket((uint32_t) window.size()));
 
 		// 4.3.2. floor curve decode
-		std::vector<float> floor_outputs(window.size() * header.audio_channels);
-		std::vector<bool> floor_output_used(header.audio_channels);
+		// Only the first half is used, see the dot product below.
+		DataRange<float> floor_outputs = scratch.alloc<float>(window.size() / 2 * header.audio_channels);
+		DataRange<bool> floor_output_used = scratch.alloc<bool>(header.audio_channels);
 		for(uint8_t channel = 0; channel < header.audio_channels; ++channel) {
 			uint8_t submap_number = mapping.muxs[channel];
 			uint8_t floor_number = mapping.submaps[submap_number].floor;
-			push_data_u8(this, "floor_number", channel, &floor_number, 1);
+			push_data_u8(&state, "floor_number", channel, &floor_number, 1);
 			const VorbisFloor& floor = setup.floors[floor_number];
-			DataRange<float> out(&floor_outputs[window.size() * channel], window.size());
+			DataRange<float> out(&floor_outputs[window.size() / 2 * channel], window.size() / 2);
 			bool use_output = false;
-			CHECK_ERR(floor.decode(reader, setup.codebooks, out, use_output));
+			CHECK_ERR(floor.decode(reader, setup.codebooks, out, use_output, scratch, &state));
 			floor_output_used[channel] = use_output;
 			if(use_output)
-				push_data_float(this, "floor_outputs", channel, out.begin(), out.size());
+				push_data_float(&state, "floor_outputs", channel, out.begin(), out.size());
 		}
 
 		// 4.3.3. nonzero vector propagate
@@ -1180,105 +2030,115 @@ struct VorbisStream {
 		}
 
 		// 4.3.4. residue decode
-		std::vector<std::vector<float>> residue_outputs(header.audio_channels);
+		// The residue of each channel is decoded directly into residue_outputs.
+		DataRange<DataRange<float>> residue_outputs = scratch.alloc<DataRange<float>>(header.audio_channels);
+		DataRange<bool> channel_used = scratch.alloc<bool>(header.audio_channels);
+		DataRange<DataRange<float>> out = scratch.alloc<DataRange<float>>(header.audio_channels);
 		for(size_t i = 0; i < mapping.submaps.size(); ++i) {
 			const VorbisMapping::Submap& submap = mapping.submaps[i];
-			uint8_t num_channel_per_submap = 0;
-			std::vector<bool> channel_used(header.audio_channels);
-			for(uint8_t j = 0; j < header.audio_channels; ++j) {
-				if(mapping.muxs[j] == i) {
-					channel_used[num_channel_per_submap] = floor_output_used[j];
-					++num_channel_per_submap;
-				}
-			}
-			channel_used.resize(num_channel_per_submap);
 			const VorbisResidue& residue = setup.residues[submap.residue];
 			uint32_t decode_len = residue.getDecodeLen((uint32_t) window.size());
-			std::vector<std::vector<float>> out(num_channel_per_submap);
-			for(uint8_t j = 0; j < num_channel_per_submap; ++j)
-				out[j].resize(decode_len, 0);
-			CHECK_ERR(residue.decode(reader, setup.codebooks, num_channel_per_submap, channel_used, decode_len, out));
-			num_channel_per_submap = 0;
+			uint8_t num_channel_per_submap = 0;
 			for(uint8_t j = 0; j < header.audio_channels; ++j) {
 				if(mapping.muxs[j] == i) {
-					CHECK(out[num_channel_per_submap].size() == decode_len);
-					residue_outputs[j].swap(out[num_channel_per_submap]);
+					residue_outputs[j] = scratch.alloc<float>(decode_len);
+					std::fill(residue_outputs[j].begin(), residue_outputs[j].end(), 0.f);
+					channel_used[num_channel_per_submap] = floor_output_used[j];
+					out[num_channel_per_submap] = residue_outputs[j];
 					++num_channel_per_submap;
 				}
 			}
+			CHECK_ERR(residue.decode(reader, setup.codebooks, num_channel_per_submap, channel_used.begin(), decode_len, out.begin(), scratch));
 		}
 		for(uint8_t channel = 0; channel < header.audio_channels; ++channel)
-			push_data_float(this, "after_residue", channel, &residue_outputs[channel][0], residue_outputs[channel].size());
+			push_data_float(&state, "after_residue", channel, residue_outputs[channel].begin(), residue_outputs[channel].size());
 
 		// 4.3.5. inverse coupling
 		for(size_t i = mapping.couplings.size(); i > 0; --i) {
 			const VorbisMapping::Coupling& coupling = mapping.couplings[i - 1];
-			std::vector<float>& magnitude_vector = residue_outputs[coupling.magintude];
-			std::vector<float>& angle_vector = residue_outputs[coupling.angle];
+			DataRange<float>& magnitude_vector = residue_outputs[coupling.magintude];
+			DataRange<float>& angle_vector = residue_outputs[coupling.angle];
 			CHECK(magnitude_vector.size() == angle_vector.size());
-			for(size_t j = 0; j < magnitude_vector.size(); ++j) {
-				float mag_val = magnitude_vector[j];
-				float ang_val = angle_vector[j];
-				float mag_val_new = mag_val, ang_val_new = ang_val;
-				if(mag_val > 0) {
-					if(ang_val > 0) {
-						ang_val_new = mag_val - ang_val;
-					} else {
-						ang_val_new = mag_val;
-						mag_val_new = mag_val + ang_val;
-					}
-				} else {
-					if(ang_val > 0) {
-						ang_val_new = mag_val + ang_val;
-					} else {
-						ang_val_new = mag_val;
-						mag_val_new = mag_val - ang_val;
-					}
-				}
-				magnitude_vector[j] = mag_val_new;
-				angle_vector[j] = ang_val_new;
-			}
+			simd_inverse_coupling(magnitude_vector.begin(), angle_vector.begin(), magnitude_vector.size());
 		}
 
 		// 4.3.6. dot product
 		// operate inplace on the residue_data.
 		for(uint8_t channel = 0; channel < header.audio_channels; ++channel) {
-			DataRange<float> residue_data(residue_outputs[channel]);
+			DataRange<float>& residue_data = residue_outputs[channel];
 			if(floor_output_used[channel]) {
-				DataRange<float> floor_data(&floor_outputs[window.size() * channel], window.size());
+				DataRange<float> floor_data(&floor_outputs[window.size() / 2 * channel], window.size() / 2);
 				CHECK(floor_data.size() >= window.size() / 2);
 				CHECK(residue_data.size() >= window.size() / 2);
 				for(size_t i = 0; i < window.size() / 2; ++i)
 					residue_data[i] *= floor_data[i];
 			}
-			push_data_float(this, "after_envelope", channel, residue_data.begin(), residue_data.size());
+			push_data_float(&state, "after_envelope", channel, residue_data.begin(), residue_data.size());
 		}
 
 		// 4.3.7. inverse MDCT
-		const Mdct& mdct = this->mdct[mode.block_flag ? 1 : 0];
-		std::vector<float> pcm(mdct.n);
-		for(uint8_t channel = 0; channel < header.audio_channels; ++channel) {
-			DataRange<float> residue_data(residue_outputs[channel]);
+		const Mdct& mdct = setup.mdct[mode.block_flag ? 1 : 0];
+		CHECK(mdct.n == mode.blocksize); // cur window size
+		size_t channel = 0;
+		if(header.audio_channels >= state.batch_mdct_min_channels) {
+			// Batches of 4 channels, one per SIMD lane, with the twiddles shared.
+			// The overlap/add reads the interleaved output directly.
+			DataRange<float> batch_in = scratch.alloc<float>(mdct.n / 2 * 4), batch_out = scratch.alloc<float>(mdct.n * 4);
+			for(; channel < header.audio_channels; channel += 4) {
+				size_t num = std::min(size_t(4), header.audio_channels - channel);
+				if(num < 4)
+					std::fill(batch_in.begin(), batch_in.end(), 0.f);
+				for(size_t c = 0; c < num; ++c) {
+					const DataRange<float>& residue_data = residue_outputs[channel + c];
+					CHECK(mdct.n == residue_data.size() * 2);
+					for(size_t i = 0; i < residue_data.size(); ++i)
+						batch_in[i * 4 + c] = residue_data[i];
+				}
+				mdct.backward_x4(batch_in.begin(), batch_out.begin());
+				for(size_t c = 0; c < num; ++c)
+					push_data_float_strided(&state, "pcm_after_mdct", int(channel + c), &batch_out[c], mdct.n, 4);
+				CHECK_ERR(state.addPcmFrames_x4(uint8_t(channel), uint8_t(num), DataRange<const float>(batch_out.begin(), batch_out.size()), window, window_slopes));
+			}
+		}
+		DataRange<float> pcm = scratch.alloc<float>(channel < header.audio_channels ? mdct.n : 0);
+		for(; channel < header.audio_channels; ++channel) {
+			DataRange<float>& residue_data = residue_outputs[channel];
 			CHECK(mdct.n == residue_data.size() * 2);
-			CHECK(mdct.n == mode.blocksize); // cur window size
-			mdct.backward(residue_data.begin(), pcm.data());
-			push_data_float(this, "pcm_after_mdct", channel, pcm.data(), pcm.size());
+			mdct.backward(residue_data.begin(), pcm.begin());
+			push_data_float(&state, "pcm_after_mdct", int(channel), pcm.begin(), pcm.size());
 			// overlap/add data
-			CHECK_ERR(state.addPcmFrame(channel, DataRange<const float>(pcm), window));
+			CHECK_ERR(state.addPcmFrame(uint8_t(channel), DataRange<const float>(pcm.begin(), pcm.size()), window, window_slopes));
 		}
 
-		push_data_u8(this, "finish_audio_packet", -1, nullptr, 0);
+		push_data_u8(&state, "finish_audio_packet", -1, nullptr, 0);
 		CHECK_ERR(state.forwardReadyPcm(callbacks));
 
 		return OkOrError();
 	}
 };
 
+struct VorbisStream {
+	VorbisIdHeader header; // as parsed from the id header packet
+	std::shared_ptr<const VorbisDecoderContext> context; // set after the setup header
+	uint32_t packet_counts_;
+	uint32_t audio_packet_counts_;
+	VorbisStreamDecodeState decode_state;
+	// Assembly buffer for a packet which spans multiple pages (HeaderFlag_Continued).
+	// Only used for such packets, all others are passed directly from the page data.
+	std::vector<uint8_t> continued_packet_;
+	bool has_continued_packet_;
+
+	VorbisStream() : packet_counts_(0), audio_packet_counts_(0), has_continued_packet_(false) {}
+	VorbisStream(const VorbisStream&) = delete; // registered by its address, see register_decoder_ref
+	VorbisStream& operator=(const VorbisStream&) = delete;
+	~VorbisStream() { unregister_decoder_ref(this); }
+};
+
 
 struct VorbisPacket {
 	VorbisStream* stream;
-	uint8_t* data;
-	uint32_t data_len; // never more than 256*256
+	const uint8_t* data;
+	uint32_t data_len; // can be more than one page, see OggReader
 
 	OkOrError parse_id(ParseCallbacks& callbacks) {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html 4.2.2
@@ -1345,39 +2205,166 @@ struct VorbisPacket {
 		uint8_t type = data[0];
 		CHECK(type == 5);
 		CHECK(memcmp(&data[1], "vorbis", 6) == 0);
-		ConstDataReader reader(data + 7, data_len - 7);
-		BitReader bitReader(&reader);
-		CHECK_ERR(stream->setup.parse(bitReader, stream->header));
-		CHECK(reader.reachedEnd());
-		stream->mdct[0].init(stream->header.get_blocksize_0());
-		stream->mdct[1].init(stream->header.get_blocksize_1());
-		stream->decode_state.init(
-			stream->header.audio_channels,
-			// Min buffer would be sth like min(blocksize0,blocksize1) * 2 or even a bit less.
-			// However, doesn't matter if we have the buffer too large.
-			// Actually that should be faster.
-			uint32_t(stream->header.get_blocksize_0()) * 5 + uint32_t(stream->header.get_blocksize_1()) * 5);
+		VorbisDecoderContextCache& cache = VorbisDecoderContextCache::instance();
+		stream->context = cache.find(stream->header, data + 7, data_len - 7);
+		if(!stream->context) {
+			std::shared_ptr<VorbisStreamSetup> setup = std::make_shared<VorbisStreamSetup>();
+			PacketBitReader reader(data + 7, data_len - 7);
+			CHECK_ERR(setup->parse(reader, stream->header));
+			CHECK(reader.reachedEnd());
+			std::shared_ptr<VorbisDecoderContext> context = std::make_shared<VorbisDecoderContext>();
+			context->header = stream->header;
+			context->setup = setup;
+			stream->context = cache.insert(stream->header, data + 7, data_len - 7, context);
+		}
+		const VorbisStreamSetup& setup = *stream->context->setup;
+		stream->context->init_decode_state(stream->decode_state);
 		register_decoder_ref(stream, "ParseOggVorbis", stream->header.audio_sample_rate, stream->header.audio_channels);
 		register_decoder_alias(stream, &stream->decode_state);
-		for(VorbisFloor& floor : stream->setup.floors) {
-			if(floor.floor_type == 1) {
-				VorbisFloor1& floor1 = floor.floor1;
-				register_decoder_alias(stream, &floor1);
+		for(const VorbisFloor& floor : setup.floors) {
+			if(floor.floor_type == 0)
+				push_data_u8(stream, "floor0_unpack order", -1, &floor.floor0.order, 1);
+			else if(floor.floor_type == 1) {
+				const VorbisFloor1& floor1 = floor.floor1;
 				push_data_u8(stream, "floor1_unpack multiplier", -1, &floor1.multiplier, 1);
 				push_data_u32(stream, "floor1_unpack xs", -1, &floor1.xs[0], floor1.xs.size());
 			}
 		}
 		push_data_u8(stream, "finish_setup", -1, nullptr, 0);
-		CHECK(callbacks.gotSetup(stream->setup));
+		CHECK(callbacks.gotSetup(setup));
 		return OkOrError();
 	}
 
 	OkOrError parse_audio(ParseCallbacks& callbacks) {
 		// https://xiph.org/vorbis/doc/Vorbis_I_spec.html
 		// https://github.com/runningwild/gorbis/blob/master/vorbis/codec.go
-		ConstDataReader reader(data, data_len);
-		BitReader bitReader(&reader);
-		return stream->parse_audio(bitReader, stream->decode_state, callbacks);
+		CHECK(stream->context);
+		if(stream->decode_state.skip_packets) {
+			PacketBitReader reader(data, data_len);
+			uint32_t win_size = 0;
+			CHECK_ERR(stream->context->peek_audio_window_size(reader, win_size));
+			bool decode = false;
+			CHECK_ERR(stream->decode_state.skipAudioPacket(win_size, stream->header.get_blocksize_1(), decode));
+			if(!decode)
+				return OkOrError();
+		}
+		PacketBitReader reader(data, data_len);
+		return stream->context->parse_audio(reader, stream->decode_state, callbacks);
+	}
+};
+
+
+struct OggSeekIndex {
+	// Maps granule pos -> byte offset of the page, for OggReader::seek_to_sample with a single read.
+	// Only pages which can be used for priming are stored (see OggReader::seek_to_sample).
+	// Built by OggReader::build_seek_index.
+	// Can be stored as a sidecar file next to the Ogg file (sidecar_filename),
+	// or as a blob somewhere else (serialize/deserialize).
+	// The file size and the CRCs of the pages are used to detect a stale index.
+	struct Entry {
+		int64_t granule_pos;
+		uint64_t offset;
+		uint32_t page_crc;
+	};
+	uint32_t stream_serial_num;
+	uint64_t file_size;
+	uint64_t audio_start_offset;
+	std::vector<Entry> entries; // sorted by granule pos (and offset)
+
+	enum { Version = 1 };
+
+	OggSeekIndex() : stream_serial_num(0), file_size(0), audio_start_offset(0) {}
+
+	static std::string sidecar_filename(const std::string& ogg_filename) {
+		return ogg_filename + ".seekidx";
+	}
+
+	// Returns the last entry with granule pos <= sample_pos, or nullptr.
+	const Entry* find(uint64_t sample_pos) const {
+		auto it = std::upper_bound(
+			entries.begin(), entries.end(), sample_pos,
+			[](uint64_t pos, const Entry& entry) { return pos < uint64_t(entry.granule_pos); });
+		if(it == entries.begin())
+			return nullptr;
+		return &*(it - 1);
+	}
+
+	// Format (little endian): magic "OggVSIdx", version u32, stream serial u32, file size u64,
+	// audio start offset u64, num entries u64, entries (granule pos i64, offset u64, page CRC u32),
+	// and finally the CRC u32 of all the previous bytes.
+	std::vector<uint8_t> serialize() const {
+		std::vector<uint8_t> out;
+		out.insert(out.end(), _magic(), _magic() + 8);
+		_write<uint32_t>(out, Version);
+		_write<uint32_t>(out, stream_serial_num);
+		_write<uint64_t>(out, file_size);
+		_write<uint64_t>(out, audio_start_offset);
+		_write<uint64_t>(out, entries.size());
+		for(const Entry& entry : entries) {
+			_write<int64_t>(out, entry.granule_pos);
+			_write<uint64_t>(out, entry.offset);
+			_write<uint32_t>(out, entry.page_crc);
+		}
+		_write<uint32_t>(out, update_crc(0, out.data(), int(out.size())));
+		return out;
+	}
+
+	OkOrError deserialize(const uint8_t* data, size_t data_len) {
+		CHECK(data_len >= 8 + 4 * 2 + 8 * 3 + 4);
+		CHECK(memcmp(data, _magic(), 8) == 0);
+		uint32_t crc = 0;
+		memcpy(&crc, data + data_len - 4, 4);
+		endian_swap_to_little_endian(crc);
+		CHECK(update_crc(0, data, int(data_len - 4)) == crc);
+		size_t pos = 8;
+		CHECK(_read<uint32_t>(data, pos) == Version);
+		stream_serial_num = _read<uint32_t>(data, pos);
+		file_size = _read<uint64_t>(data, pos);
+		audio_start_offset = _read<uint64_t>(data, pos);
+		uint64_t num_entries = _read<uint64_t>(data, pos);
+		CHECK(num_entries == (data_len - pos - 4) / 20 && pos + num_entries * 20 + 4 == data_len);
+		entries.resize((size_t) num_entries);
+		for(Entry& entry : entries) {
+			entry.granule_pos = _read<int64_t>(data, pos);
+			entry.offset = _read<uint64_t>(data, pos);
+			entry.page_crc = _read<uint32_t>(data, pos);
+		}
+		return OkOrError();
+	}
+
+	OkOrError save(const std::string& filename) const {
+		std::vector<uint8_t> data = serialize();
+		FILE* fp = fopen(filename.c_str(), "wb");
+		CHECK(fp != NULL);
+		size_t c = fwrite(data.data(), data.size(), 1, fp);
+		CHECK(fclose(fp) == 0 && c == 1);
+		return OkOrError();
+	}
+
+	OkOrError load(const std::string& filename) {
+		FileReader reader(filename);
+		CHECK_ERR(reader.isValid());
+		std::vector<uint8_t> data((size_t) reader.size());
+		CHECK(data.empty() || reader.read(data.data(), data.size(), 1) == 1);
+		return deserialize(data.data(), data.size());
+	}
+
+	static const uint8_t* _magic() { return (const uint8_t*) "OggVSIdx"; }
+
+	template<typename T>
+	static void _write(std::vector<uint8_t>& out, T v) {
+		endian_swap_to_little_endian(v);
+		const uint8_t* ptr = (const uint8_t*) &v;
+		out.insert(out.end(), ptr, ptr + sizeof(T));
+	}
+
+	template<typename T>
+	static T _read(const uint8_t* data, size_t& pos) {
+		T v;
+		memcpy(&v, data + pos, sizeof(T));
+		pos += sizeof(T);
+		endian_swap_to_little_endian(v);
+		return v;
 	}
 };
 
@@ -1388,14 +2375,65 @@ struct OggReader {
 	size_t packet_counts_;
 	std::shared_ptr<IReader> reader_;
 	ParseCallbacks& callbacks_;
-
-	OggReader(ParseCallbacks& callbacks) : packet_counts_(0), callbacks_(callbacks) {}
-
-	OkOrError open_file(const std::string& filename) {
+	CrcCheck crc_check_;
+	PageCrcVerifier crc_verifier_; // after reader_, such that it is destroyed first
+	bool headers_only_; // only parse the header packets, skip the audio packets, see probe()
+	uint8_t batch_mdct_min_channels_; // see set_batch_mdct_min_channels()
+	uint64_t audio_start_offset_; // byte offset of the first audio page, set by _read_headers()
+	uint32_t seek_chunk_size_; // see set_seek_chunk_size()
+	bool prime_next_page_; // see seek_to_sample()
+	bool has_prime_page_crc_;
+	uint32_t prime_page_crc_; // if has_prime_page_crc_, from the seek index, to check for a stale index
+	OggSeekIndex* seek_index_builder_; // if set, _read_page adds the pages, see build_seek_index()
+	uint64_t page_offset_; // of buffer_page_, only set if seek_index_builder_
+	uint64_t range_start_, range_end_; // see set_sample_range()
+	bool range_done_;
+	// The packets of buffer_page_ are handled one by one, see read_next_packet().
+	bool page_in_progress_;
+	bool page_prime_, page_skip_continued_;
+	int page_segment_i_, page_last_complete_segment_;
+	size_t page_data_offset_;
+	size_t page_data_avail_; // less than data_len only while the page is being received by feed()
+	enum FeedState { FeedState_Header, FeedState_SegmentTable, FeedState_Data };
+	FeedState feed_state_; // see feed()
+	size_t feed_pos_; // in the current part of the page (header or segment table)
+
+	OggReader(ParseCallbacks& callbacks) :
+		packet_counts_(0), callbacks_(callbacks), crc_check_(CrcCheck_Verify), headers_only_(false), batch_mdct_min_channels_(4),
+		audio_start_offset_(0), seek_chunk_size_(1 << 16), prime_next_page_(false), has_prime_page_crc_(false), prime_page_crc_(0),
+		seek_index_builder_(nullptr), page_offset_(0),
+		range_start_(0), range_end_(UINT64_MAX), range_done_(false),
+		page_in_progress_(false), page_prime_(false), page_skip_continued_(false),
+		page_segment_i_(0), page_last_complete_segment_(-1), page_data_offset_(0), page_data_avail_(0),
+		feed_state_(FeedState_Header), feed_pos_(0) {}
+
+	// CrcCheck_VerifyLazily needs a reader with IReader::view (memory, mmap). Otherwise it verifies directly.
+	// For feed(), the default CrcCheck_Verify means a latency of one page (see feed()).
+	// Use CrcCheck_VerifyLazily or CrcCheck_Skip for a latency of one packet.
+	void set_crc_check(CrcCheck crc_check) { crc_check_ = crc_check; }
+
+	// Streams with at least this number of channels do the inverse MDCT in batches of 4 channels.
+	// The result is exactly the same. Mostly for tests (1 forces the batches). Only for streams started afterwards.
+	void set_batch_mdct_min_channels(uint8_t num_channels) { batch_mdct_min_channels_ = num_channels; }
+
+	// When searching for pages (seek_to_sample(), probe()), the file is read in chunks of this size.
+	// The bisection in seek_to_sample() stops at this size and scans the rest linearly.
+	// Mostly for tests, to get the bisection also with small files.
+	void set_seek_chunk_size(uint32_t chunk_size) { assert(chunk_size > 0); seek_chunk_size_ = chunk_size; }
+
+	// With use_mmap, the pages and packets are used directly from the file mapping, without any copy.
+	// If the file cannot be mapped (e.g. a pipe), we fall back to the stdio reader.
+	OkOrError open_file(const std::string& filename, bool use_mmap = true) {
+		if(use_mmap) {
+			std::shared_ptr<MmapReader> reader = std::make_shared<MmapReader>(filename);
+			if(!reader->isValid().is_error_)
+				return set_reader(reader);
+		}
 		return set_reader(std::make_shared<FileReader>(filename));
 	}
 
 	OkOrError set_reader(const std::shared_ptr<IReader>& reader) {
+		crc_verifier_.drain(); // it might still use the data of the old reader
 		reader_ = reader;
 		CHECK_ERR(reader_->isValid());
 		return OkOrError();
@@ -1403,6 +2441,14 @@ struct OggReader {
 
 	OkOrError read_next_page(bool& reached_eof) {
 		CHECK(reader_.get());
+		if(page_in_progress_) { // finish the page, see read_next_packet()
+			bool page_done = false;
+			while(!page_done)
+				CHECK_ERR(_read_page_packet(page_done));
+			return OkOrError();
+		}
+		if(seek_index_builder_)
+			page_offset_ = reader_->tell();
 		Page::ReadHeaderResult res = buffer_page_.read_header(reader_.get());
 		if(res == Page::ReadHeaderResult::Ok)
 			CHECK_ERR(_read_page());
@@ -1413,15 +2459,112 @@ struct OggReader {
 		return OkOrError();
 	}
 
+	// Like read_next_page, but handles only a single packet (or none, e.g. if it continues on the next page).
+	// I.e. the callbacks get at most the PCM of one audio packet.
+	OkOrError read_next_packet(bool& reached_eof) {
+		CHECK(reader_.get());
+		if(!page_in_progress_) {
+			if(seek_index_builder_)
+				page_offset_ = reader_->tell();
+			Page::ReadHeaderResult res = buffer_page_.read_header(reader_.get());
+			if(res == Page::ReadHeaderResult::Eof) {
+				reached_eof = true;
+				return OkOrError();
+			}
+			if(res != Page::ReadHeaderResult::Ok)
+				return OkOrError("read error");
+			CHECK_ERR(_begin_page());
+		}
+		bool page_done = false;
+		return _read_page_packet(page_done);
+	}
+
+	// Incremental decoding for live input, as an alternative to an IReader.
+	// The data can be split anywhere, e.g. also within the page header or the segment table.
+	// A partial page is kept in buffer_page_, and every packet is decoded (and forwarded to the callbacks)
+	// as soon as its data is complete, i.e. the latency is one packet, not one page.
+	// Except for CrcCheck_Verify (the default), where we need the full page for the CRC before we use any of it,
+	// i.e. the latency is one page then.
+	// With CrcCheck_VerifyLazily, the CRC is verified when the page is complete, i.e. after its packets were forwarded.
+	// Never blocks. Call feed_end() when the input is finished.
+	OkOrError feed(const uint8_t* data, size_t data_len) {
+		Page& page = buffer_page_;
+		while(true) {
+			if(feed_state_ == FeedState_Header) {
+				size_t n = std::min(data_len, sizeof(PageHeader) - feed_pos_);
+				memcpy((uint8_t*) &page.header + feed_pos_, data, n);
+				data += n; data_len -= n; feed_pos_ += n;
+				if(feed_pos_ < sizeof(PageHeader))
+					break;
+				CHECK_ERR(page.prepare_header());
+				page.segment_table = page.segment_table_buf_;
+				feed_state_ = FeedState_SegmentTable;
+				feed_pos_ = 0;
+			}
+			else if(feed_state_ == FeedState_SegmentTable) {
+				size_t n = std::min(data_len, page.header.page_segments_num - feed_pos_);
+				memcpy(page.segment_table_buf_ + feed_pos_, data, n);
+				data += n; data_len -= n; feed_pos_ += n;
+				if(feed_pos_ < page.header.page_segments_num)
+					break;
+				page.data_len = 0;
+				for(uint8_t i = 0; i < page.header.page_segments_num; ++i)
+					page.data_len += page.segment_table[i];
+				page.data = page.data_buf_;
+				page_data_avail_ = 0;
+				CHECK_ERR(_setup_page());
+				feed_state_ = FeedState_Data;
+				feed_pos_ = 0;
+			}
+			else {
+				size_t n = std::min(data_len, size_t(page.data_len - page_data_avail_));
+				memcpy(page.data_buf_ + page_data_avail_, data, n);
+				data += n; data_len -= n; page_data_avail_ += n;
+				CHECK_ERR(_feed_page_packets());
+				if(page_in_progress_) {
+					assert(data_len == 0);
+					break;
+				}
+				feed_state_ = FeedState_Header;
+			}
+		}
+		return OkOrError();
+	}
+
+	OkOrError _feed_page_packets() {
+		if(page_data_avail_ == buffer_page_.data_len) {
+			if(crc_check_ != CrcCheck_Skip)
+				CHECK(Page::calc_crc(buffer_page_.header, buffer_page_.segment_table, buffer_page_.data, buffer_page_.data_len) == buffer_page_.header.page_crc_checksum);
+		}
+		else if(crc_check_ == CrcCheck_Verify)
+			return OkOrError();
+		while(page_in_progress_) {
+			int segment_i = page_segment_i_;
+			bool page_done = false;
+			CHECK_ERR(_read_page_packet(page_done));
+			if(!page_done && page_segment_i_ == segment_i) // wait for more data
+				break;
+		}
+		return OkOrError();
+	}
+
+	// The input of feed() is finished. It is an error if it stopped within a page.
+	OkOrError feed_end() {
+		if(feed_state_ != FeedState_Header || feed_pos_ != 0)
+			return OkOrError("truncated page at the end of the input");
+		return OkOrError();
+	}
+
 	OkOrError read_until_end() {
 		bool reached_eof = false;
-		while(!reached_eof)
+		while(!reached_eof && !range_done_)
 			CHECK_ERR(read_next_page(reached_eof));
+		CHECK_ERR(crc_verifier_.finish());
 		return OkOrError();
 	}
 
-	OkOrError full_read(const std::string& filename) {
-		CHECK_ERR(open_file(filename));
+	OkOrError full_read(const std::string& filename, bool use_mmap = true) {
+		CHECK_ERR(open_file(filename, use_mmap));
 		return read_until_end();
 	}
 
@@ -1430,50 +2573,551 @@ struct OggReader {
 		return read_until_end();
 	}
 
+	struct ProbeInfo {
+		uint32_t stream_serial_num;
+		VorbisIdHeader header;
+		// PCM position of the first sample. Usually 0, but e.g. a cut live capture can start later.
+		// Like vorbisfile (_initial_pcmoffset): the granule pos of the first audio page with a granule pos,
+		// minus the PCM of its packets. Negative (i.e. samples to trim at the start) is clamped to 0.
+		int64_t start_granule_pos;
+		// Granule pos of the last page.
+		int64_t end_granule_pos;
+		int64_t num_samples() const { return end_granule_pos - start_granule_pos; }
+	};
+
+	// Parses only the headers (of the first stream), the first audio page(s) without decoding them,
+	// and then seeks from the end of the file to find the last page.
+	// The callbacks get gotHeader, gotComments and gotSetup.
+	// Needs a seekable reader. Afterwards, the reader is back at the start.
+	OkOrError probe(ProbeInfo& info) {
+		CHECK(reader_.get());
+		CHECK(reader_->isSeekable());
+		CHECK_ERR(reset());
+		headers_only_ = true;
+		OkOrError probe_res = _probe(info);
+		headers_only_ = false;
+		if(probe_res.is_error_)
+			return probe_res;
+		return reset();
+	}
+
+	OkOrError probe_file(const std::string& filename, ProbeInfo& info) {
+		CHECK_ERR(open_file(filename));
+		return probe(info);
+	}
+
+	OkOrError probe_from_memory(const uint8_t* data, size_t data_len, ProbeInfo& info) {
+		CHECK_ERR(set_reader(std::make_shared<ConstDataReader>(data, data_len)));
+		return probe(info);
+	}
+
+	// Only PCM in [start, end) will be forwarded to the callbacks (trimmed exactly).
+	// Audio packets before the range are skipped, i.e. only their mode is parsed, to know the window sizes.
+	// Once we are behind the range, read_until_end() stops, and no further packets are decoded.
+	void set_sample_range(uint64_t start, uint64_t end) {
+		range_start_ = start;
+		range_end_ = end;
+		range_done_ = false;
+		for(auto& it : streams_)
+			_apply_sample_range(it.second);
+	}
+
+	void _apply_sample_range(VorbisStream& stream) {
+		stream.decode_state.skip_until_pos = range_start_;
+		stream.decode_state.stop_at_pos = range_end_;
+		if(stream.decode_state.abs_total_pos < range_start_ && !stream.decode_state.skip_packets) {
+			if(stream.audio_packet_counts_ == 0)
+				stream.decode_state.startSkipping();
+			else
+				stream.decode_state.skip_packets = true; // continue from the last decoded packet
+		}
+	}
+
+	// Seeks to start if possible, otherwise reads from the current position.
+	// The decoding time is thus mostly proportional to the range length.
+	OkOrError read_sample_range(uint64_t start, uint64_t end) {
+		CHECK(reader_.get());
+		CHECK(start <= end);
+		set_sample_range(start, end);
+		if(start > 0 && reader_->isSeekable())
+			CHECK_ERR(seek_to_sample(start));
+		return read_until_end();
+	}
+
+	// After this, read_next_page() or read_until_end() will continue to decode,
+	// and the first PCM data forwarded to the callbacks starts exactly at the given sample.
+	// The output is the same as from a full decode.
+	// Needs a seekable reader. We only support files with a single logical stream here.
+	OkOrError seek_to_sample(uint64_t sample_pos) {
+		CHECK(reader_.get());
+		CHECK(reader_->isSeekable());
+		CHECK_ERR(crc_verifier_.finish());
+		if(_need_read_headers())
+			CHECK_ERR(_read_headers());
+		CHECK(streams_.size() == 1);
+		uint32_t serial = streams_.begin()->first;
+		VorbisStream& stream = streams_.begin()->second;
+
+		// Bisect for the last page with granule pos <= sample_pos.
+		// We then decode the last packet of that page without output (priming the overlap-add),
+		// and the next packet gives the PCM starting at the granule pos of the page.
+		// If the last packet of that page started on a previous page, we cannot use it for priming,
+		// and take the page before.
+		PageLocation page;
+		bool found = false;
+		uint64_t target = sample_pos;
+		while(true) {
+			CHECK_ERR(_bisect_page(serial, target, page, found));
+			if(!found || page.can_prime)
+				break;
+			if(page.granule_pos == 0) {
+				found = false;
+				break;
+			}
+			target = uint64_t(page.granule_pos) - 1;
+		}
+
+		return _seek_to_page(stream, sample_pos, found ? &page.offset : nullptr, nullptr);
+	}
+
+	OkOrError _seek_to_page(VorbisStream& stream, uint64_t sample_pos, const uint64_t* page_offset, const uint32_t* page_crc) {
+		stream.has_continued_packet_ = false;
+		stream.decode_state.skip_until_pos = sample_pos;
+		stream.decode_state.stop_at_pos = range_end_;
+		range_done_ = false;
+		has_prime_page_crc_ = false;
+		page_in_progress_ = false;
+		if(page_offset) {
+			CHECK_ERR(reader_->seek(*page_offset));
+			prime_next_page_ = true;
+			if(page_crc) {
+				has_prime_page_crc_ = true;
+				prime_page_crc_ = *page_crc;
+			}
+		}
+		else {
+			// Decode from the first audio page.
+			CHECK_ERR(reader_->seek(audio_start_offset_));
+			stream.decode_state.reset(0);
+			stream.decode_state.startSkipping();
+		}
+		return OkOrError();
+	}
+
+	// Like seek_to_sample, but uses the index instead of bisecting, i.e. just a single read of the page.
+	// The headers are read first if needed.
+	// Returns an error if the index does not match the file (also detected on the page, via its CRC).
+	OkOrError seek_to_sample(uint64_t sample_pos, const OggSeekIndex& index) {
+		CHECK(reader_.get());
+		CHECK(reader_->isSeekable());
+		CHECK_ERR(crc_verifier_.finish());
+		if(reader_->size() != index.file_size)
+			return OkOrError("seek index is stale: file size mismatch");
+		if(_need_read_headers())
+			CHECK_ERR(_read_headers());
+		CHECK(streams_.size() == 1);
+		if(streams_.begin()->first != index.stream_serial_num || audio_start_offset_ != index.audio_start_offset)
+			return OkOrError("seek index is stale: stream mismatch");
+		VorbisStream& stream = streams_.begin()->second;
+		const OggSeekIndex::Entry* entry = index.find(sample_pos);
+		if(!entry)
+			return _seek_to_page(stream, sample_pos, nullptr, nullptr);
+		return _seek_to_page(stream, sample_pos, &entry->offset, &entry->page_crc);
+	}
+
+	// One pass over the whole file, only reading the headers and the pages, without decoding the audio.
+	// Afterwards, the reader is back at the start.
+	OkOrError build_seek_index(OggSeekIndex& index) {
+		CHECK(reader_.get());
+		CHECK(reader_->isSeekable());
+		CHECK_ERR(reset());
+		index = OggSeekIndex();
+		index.file_size = reader_->size();
+		headers_only_ = true;
+		seek_index_builder_ = &index;
+		OkOrError read_res = read_until_end();
+		headers_only_ = false;
+		seek_index_builder_ = nullptr;
+		if(read_res.is_error_)
+			return read_res;
+		CHECK(index.audio_start_offset > 0);
+		return reset();
+	}
+
+	void _add_seek_index_entry(VorbisStream& stream) { // Called in _read_page().
+		OggSeekIndex& index = *seek_index_builder_;
+		if(index.audio_start_offset == 0) {
+			if(stream.packet_counts_ < 3)
+				return;
+			// First page after the headers.
+			index.stream_serial_num = buffer_page_.header.stream_serial_num;
+			index.audio_start_offset = page_offset_ + sizeof(PageHeader) + buffer_page_.header.page_segments_num + buffer_page_.data_len;
+			return;
+		}
+		if(buffer_page_.header.stream_serial_num != index.stream_serial_num || buffer_page_.header.absolute_granule_pos == -1)
+			return;
+		if(!_page_can_prime(buffer_page_.header, buffer_page_.segment_table))
+			return;
+		OggSeekIndex::Entry entry;
+		entry.granule_pos = buffer_page_.header.absolute_granule_pos;
+		entry.offset = page_offset_;
+		entry.page_crc = buffer_page_.header.page_crc_checksum;
+		index.entries.push_back(entry);
+	}
+
+	bool _need_read_headers() const {
+		// audio_start_offset_ is only known via _read_headers(), not when the headers were decoded
+		// by a normal read before the first seek.
+		return streams_.empty() || !streams_.begin()->second.context || audio_start_offset_ == 0;
+	}
+
+	OkOrError _read_headers() {
+		CHECK_ERR(reset());
+		bool reached_eof = false;
+		CHECK_ERR(read_next_page(reached_eof));
+		CHECK(!reached_eof);
+		uint32_t serial = buffer_page_.header.stream_serial_num;
+		while(true) {
+			auto it = streams_.find(serial);
+			CHECK(it != streams_.end());
+			if(it->second.packet_counts_ >= 3) {
+				// The Vorbis spec requires that the first audio packet starts on a new page.
+				CHECK(it->second.packet_counts_ == 3 && !it->second.has_continued_packet_);
+				break;
+			}
+			CHECK_ERR(read_next_page(reached_eof));
+			CHECK(!reached_eof);
+		}
+		audio_start_offset_ = reader_->tell();
+		return OkOrError();
+	}
+
+	struct PageLocation {
+		uint64_t offset;
+		uint32_t len;
+		int64_t granule_pos;
+		bool can_prime; // whether the last completed packet of the page also starts in this page
+	};
+
+	OkOrError _bisect_page(uint32_t stream_serial_num, uint64_t sample_pos, PageLocation& page, bool& found) {
+		// Finds the last page (with a granule pos) with granule pos <= sample_pos.
+		found = false;
+		uint64_t lo = audio_start_offset_, hi = reader_->size();
+		PageLocation cur;
+		bool cur_found = false;
+		while(hi - lo > seek_chunk_size_) {
+			uint64_t mid = lo + (hi - lo) / 2;
+			CHECK_ERR(_find_next_page(stream_serial_num, mid, hi, cur, cur_found));
+			if(cur_found && uint64_t(cur.granule_pos) <= sample_pos) {
+				page = cur;
+				found = true;
+				lo = std::min(hi, cur.offset + cur.len);
+			}
+			else
+				hi = mid;
+		}
+		while(lo < hi) { // linear scan for the remaining range
+			CHECK_ERR(_find_next_page(stream_serial_num, lo, hi, cur, cur_found));
+			if(!cur_found || uint64_t(cur.granule_pos) > sample_pos)
+				break;
+			page = cur;
+			found = true;
+			lo = std::min(hi, cur.offset + cur.len);
+		}
+		return OkOrError();
+	}
+
+	static bool _page_can_prime(const PageHeader& header, const uint8_t* segment_table) {
+		// Whether the last completed packet of the page also starts in this page.
+		if(!(header.header_type_flag & HeaderFlag_Continued))
+			return true;
+		int num_complete_packets = 0;
+		for(uint8_t i = 0; i < header.page_segments_num; ++i)
+			if(segment_table[i] < 255)
+				++num_complete_packets;
+		return num_complete_packets >= 2;
+	}
+
+	OkOrError _find_next_page(uint32_t stream_serial_num, uint64_t pos, uint64_t limit, PageLocation& page, bool& found) {
+		// Finds the first valid page of the stream with granule pos, which starts in [pos, limit).
+		// Resyncs on the capture pattern and checks the CRC.
+		found = false;
+		uint64_t file_size = reader_->size();
+		std::vector<uint8_t> buf;
+		while(pos < limit) {
+			uint64_t end = std::min(limit, pos + seek_chunk_size_);
+			uint64_t read_end = std::min(file_size, end + (uint64_t) Page::MaxPageSize);
+			buf.resize((size_t) (read_end - pos));
+			CHECK_ERR(reader_->seek(pos));
+			CHECK(reader_->read(buf.data(), buf.size(), 1) == 1);
+			for(size_t i = 0; i < size_t(end - pos); ) {
+				PageHeader header;
+				size_t page_len = Page::check_page_in_buffer(&buf[i], buf.size() - i, header);
+				if(page_len == 0) {
+					++i;
+					continue;
+				}
+				if(header.stream_serial_num == stream_serial_num && header.absolute_granule_pos != -1) {
+					page.offset = pos + i;
+					page.len = uint32_t(page_len);
+					page.granule_pos = header.absolute_granule_pos;
+					page.can_prime = _page_can_prime(header, &buf[i + sizeof(PageHeader)]);
+					found = true;
+					return OkOrError();
+				}
+				i += page_len;
+			}
+			pos = end;
+		}
+		return OkOrError();
+	}
+
+	// Back to the start of the file, all streams are reset.
+	OkOrError reset() {
+		CHECK(reader_.get());
+		CHECK_ERR(crc_verifier_.finish());
+		streams_.clear();
+		packet_counts_ = 0;
+		range_done_ = false;
+		page_in_progress_ = false;
+		CHECK_ERR(reader_->seek(0));
+		return OkOrError();
+	}
+
+	OkOrError _probe(ProbeInfo& info) {
+		bool reached_eof = false;
+		CHECK_ERR(read_next_page(reached_eof));
+		CHECK(!reached_eof);
+		info.stream_serial_num = buffer_page_.header.stream_serial_num;
+		while(true) {
+			auto it = streams_.find(info.stream_serial_num);
+			CHECK(it != streams_.end());
+			if(it->second.packet_counts_ >= 3) {
+				info.header = it->second.header;
+				// The Vorbis spec requires that the first audio packet starts on a new page.
+				CHECK(!it->second.has_continued_packet_);
+				CHECK_ERR(_find_start_granule_pos(it->second, info.start_granule_pos));
+				break;
+			}
+			CHECK_ERR(read_next_page(reached_eof));
+			CHECK(!reached_eof);
+		}
+		CHECK_ERR(_find_last_granule_pos(info.stream_serial_num, info.end_granule_pos));
+		return OkOrError();
+	}
+
+	OkOrError _find_start_granule_pos(const VorbisStream& stream, int64_t& granule_pos) {
+		// Called after the headers. Like vorbisfile _initial_pcmoffset:
+		// Sum up the PCM of the audio packets (only the window sizes, see peek_audio_window_size),
+		// until the first page with a granule pos, and subtract it from that granule pos.
+		// The first packet does not return any PCM.
+		granule_pos = 0;
+		uint32_t serial = buffer_page_.header.stream_serial_num; // copy, the header is packed
+		int64_t pcm_sum = 0;
+		uint32_t prev_win_size = 0;
+		std::vector<uint8_t> packet; // only for a packet which spans pages
+		while(true) {
+			Page::ReadHeaderResult res = buffer_page_.read_header(reader_.get());
+			if(res == Page::ReadHeaderResult::Eof) // no audio page with a granule pos
+				return OkOrError();
+			CHECK(res == Page::ReadHeaderResult::Ok);
+			CHECK_ERR(buffer_page_.read(reader_.get(), crc_check_ != CrcCheck_Skip));
+			if(buffer_page_.header.stream_serial_num != serial)
+				continue;
+			uint32_t offset = 0, len = 0;
+			for(uint8_t i = 0; i < buffer_page_.header.page_segments_num; ++i) {
+				len += buffer_page_.segment_table[i];
+				if(buffer_page_.segment_table[i] == 255)
+					continue;
+				const uint8_t* data = buffer_page_.data + offset;
+				if(!packet.empty()) {
+					packet.insert(packet.end(), data, data + len);
+					data = packet.data();
+				}
+				PacketBitReader reader(data, packet.empty() ? len : packet.size());
+				uint32_t win_size = 0;
+				// Like vorbisfile, packets which are not valid audio packets are ignored.
+				if(!stream.context->peek_audio_window_size(reader, win_size).is_error_) {
+					if(prev_win_size > 0)
+						pcm_sum += prev_win_size / 4 + win_size / 4;
+					prev_win_size = win_size;
+				}
+				packet.clear();
+				offset += len;
+				len = 0;
+			}
+			if(offset < buffer_page_.data_len) // continues on the next page
+				packet.insert(packet.end(), buffer_page_.data + offset, buffer_page_.data + buffer_page_.data_len);
+			if(buffer_page_.header.absolute_granule_pos != -1) {
+				granule_pos = std::max(buffer_page_.header.absolute_granule_pos - pcm_sum, int64_t(0));
+				return OkOrError();
+			}
+		}
+	}
+
+	OkOrError _find_last_granule_pos(uint32_t stream_serial_num, int64_t& granule_pos) {
+		// Scan backwards in chunks for the last valid page of the stream which has a granule pos.
+		// For each chunk, we read a bit more, such that any page which starts in the chunk is complete.
+		uint64_t file_size = reader_->size();
+		uint64_t end = file_size;
+		uint64_t chunk_size = seek_chunk_size_;
+		std::vector<uint8_t> buf;
+		while(end > 0) {
+			uint64_t begin = end > chunk_size ? end - chunk_size : 0;
+			uint64_t read_end = std::min(file_size, end + (uint64_t) Page::MaxPageSize);
+			buf.resize((size_t) (read_end - begin));
+			CHECK_ERR(reader_->seek(begin));
+			CHECK(reader_->read(buf.data(), buf.size(), 1) == 1);
+			bool found = false;
+			for(size_t pos = 0; pos < size_t(end - begin); ) {
+				PageHeader header;
+				size_t page_len = Page::check_page_in_buffer(&buf[pos], buf.size() - pos, header);
+				if(page_len == 0) {
+					++pos;
+					continue;
+				}
+				if(header.stream_serial_num == stream_serial_num && header.absolute_granule_pos != -1) {
+					granule_pos = header.absolute_granule_pos;
+					found = true;
+				}
+				pos += page_len;
+			}
+			if(found)
+				return OkOrError();
+			end = begin;
+			if(chunk_size < (1 << 24))
+				chunk_size *= 2;
+		}
+		return OkOrError("no page with granule pos found");
+	}
+
 	OkOrError _read_page() { // Called after buffer_page_.read_header().
-		CHECK_ERR(buffer_page_.read(reader_.get()));
+		CHECK_ERR(_begin_page());
+		bool page_done = false;
+		while(!page_done)
+			CHECK_ERR(_read_page_packet(page_done));
+		return OkOrError();
+	}
+
+	OkOrError _begin_page() { // Called after buffer_page_.read_header().
+		bool lazy_crc = crc_check_ == CrcCheck_VerifyLazily && reader_->supportsView();
+		CHECK_ERR(buffer_page_.read(reader_.get(), crc_check_ == CrcCheck_Verify || (crc_check_ == CrcCheck_VerifyLazily && !lazy_crc)));
+		if(lazy_crc) {
+			CHECK_ERR(crc_verifier_.take_error());
+			crc_verifier_.push(buffer_page_);
+		}
+		page_data_avail_ = buffer_page_.data_len;
+		return _setup_page();
+	}
+
+	OkOrError _setup_page() { // Called when the header and the segment table of buffer_page_ are there.
 		if(buffer_page_.header.header_type_flag & HeaderFlag_First) {
-			CHECK(streams_.find(buffer_page_.header.stream_serial_num) == streams_.end());
-			streams_[buffer_page_.header.stream_serial_num] = VorbisStream();
+			uint32_t serial = buffer_page_.header.stream_serial_num; // copy, the header is packed
+			CHECK(streams_.find(serial) == streams_.end());
+			streams_.emplace(std::piecewise_construct, std::forward_as_tuple(serial), std::forward_as_tuple());
+			_apply_sample_range(streams_[serial]);
+			streams_[serial].decode_state.batch_mdct_min_channels = batch_mdct_min_channels_;
 		}
 		CHECK(streams_.find(buffer_page_.header.stream_serial_num) != streams_.end());
 		VorbisStream& stream = streams_[buffer_page_.header.stream_serial_num];
 
-		// pack packets: join seg table with size 255 and first with <255, each is one packet
-		size_t offset = 0;
-		uint32_t len = 0;
-		for(uint8_t segment_i = 0; segment_i < buffer_page_.header.page_segments_num; ++segment_i) {
-			len += buffer_page_.segment_table[segment_i];
+		// https://xiph.org/ogg/doc/framing.html
+		// The packets are given by the lacing values: join segments with size 255 and the first with <255.
+		// A packet which ends with a 255 segment at the end of the page continues on the next page of the stream.
+		// The granule pos of the page refers to the last packet which is completed on this page.
+		// When priming after a seek, we only decode the last completed packet of the page, and skip the others.
+		page_prime_ = prime_next_page_;
+		prime_next_page_ = false;
+		if(page_prime_ && has_prime_page_crc_) {
+			has_prime_page_crc_ = false;
+			if(buffer_page_.header.page_crc_checksum != prime_page_crc_)
+				return OkOrError("seek index is stale: page CRC mismatch");
+		}
+		if(!page_prime_)
+			CHECK(bool(buffer_page_.header.header_type_flag & HeaderFlag_Continued) == stream.has_continued_packet_);
+		page_skip_continued_ = page_prime_ && (buffer_page_.header.header_type_flag & HeaderFlag_Continued);
+		page_last_complete_segment_ = -1;
+		for(int segment_i = int(buffer_page_.header.page_segments_num) - 1; segment_i >= 0; --segment_i) {
 			if(buffer_page_.segment_table[segment_i] < 255) {
-				// new packet
-				// https://xiph.org/vorbis/doc/Vorbis_I_spec.html
-				// https://github.com/runningwild/gorbis/blob/master/vorbis/codec.go
-				// https://github.com/ioctlLR/NVorbis/blob/master/NVorbis/VorbisStreamDecoder.cs
-				VorbisPacket packet;
-				packet.stream = &stream;
-				packet.data = buffer_page_.data + offset;
+				page_last_complete_segment_ = segment_i;
+				break;
+			}
+		}
+		page_segment_i_ = 0;
+		page_data_offset_ = 0;
+		page_in_progress_ = true;
+		return OkOrError();
+	}
+
+	// Handles the next packet of buffer_page_, after _begin_page().
+	// page_done is set when the page is finished, which can be together with the last packet.
+	// With feed(), the page data might not be complete yet (page_data_avail_). Then we stop before
+	// the first packet which is not complete, without any progress.
+	OkOrError _read_page_packet(bool& page_done) {
+		VorbisStream& stream = streams_[buffer_page_.header.stream_serial_num];
+		page_done = false;
+		while(page_segment_i_ <= page_last_complete_segment_) {
+			// new packet
+			// https://xiph.org/vorbis/doc/Vorbis_I_spec.html
+			// https://github.com/runningwild/gorbis/blob/master/vorbis/codec.go
+			// https://github.com/ioctlLR/NVorbis/blob/master/NVorbis/VorbisStreamDecoder.cs
+			int segment_i = page_segment_i_;
+			uint32_t len = 0;
+			while(buffer_page_.segment_table[segment_i] == 255) // ends at page_last_complete_segment_ at latest
+				len += buffer_page_.segment_table[segment_i++];
+			len += buffer_page_.segment_table[segment_i];
+			if(page_data_offset_ + len > page_data_avail_)
+				return OkOrError();
+			page_segment_i_ = segment_i + 1;
+			if(page_prime_ && segment_i != page_last_complete_segment_) {
+				page_data_offset_ += len;
+				page_skip_continued_ = false;
+				continue;
+			}
+			CHECK(!page_skip_continued_);
+			if(page_prime_) // skip_packets will decode it if it is needed for the following packets
+				stream.decode_state.startSkipping();
+			VorbisPacket packet;
+			packet.stream = &stream;
+			if(stream.has_continued_packet_) {
+				// Only the first packet of a page can be the continued one.
+				stream.continued_packet_.insert(stream.continued_packet_.end(), buffer_page_.data + page_data_offset_, buffer_page_.data + page_data_offset_ + len);
+				stream.has_continued_packet_ = false;
+				packet.data = stream.continued_packet_.data();
+				packet.data_len = (uint32_t) stream.continued_packet_.size();
+			}
+			else {
+				packet.data = buffer_page_.data + page_data_offset_;
 				packet.data_len = len;
-				if(segment_i == buffer_page_.header.page_segments_num - 1)
-					stream.decode_state.setExpectedEndingPos(buffer_page_.header.absolute_granule_pos);
-				else
-					stream.decode_state.setExpectedEndingPos(-1);
-				if(stream.packet_counts_ == 0)
-					CHECK_ERR(packet.parse_id(callbacks_));
-				else if(stream.packet_counts_ == 1)
-					CHECK_ERR(packet.parse_comment(callbacks_));
-				else if(stream.packet_counts_ == 2)
-					CHECK_ERR(packet.parse_setup(callbacks_));
-				else {
-					CHECK_ERR(packet.parse_audio(callbacks_));
-					++stream.audio_packet_counts_;
-				}
-				++stream.packet_counts_;
-				++packet_counts_;
-				offset += len;
-				len = 0;
 			}
+			if(segment_i == page_last_complete_segment_)
+				stream.decode_state.setExpectedEndingPos(buffer_page_.header.absolute_granule_pos);
+			else
+				stream.decode_state.setExpectedEndingPos(-1);
+			page_data_offset_ += len;
+			CHECK_ERR(_handle_packet(stream, packet));
+			if(page_segment_i_ <= page_last_complete_segment_)
+				return OkOrError();
+			break;
+		}
+		if(page_data_avail_ < buffer_page_.data_len) // the remaining part of a continued packet is missing
+			return OkOrError();
+		page_done = true;
+		return _end_page(stream);
+	}
+
+	OkOrError _end_page(VorbisStream& stream) {
+		page_in_progress_ = false;
+		if(page_data_offset_ < buffer_page_.data_len) {
+			// The remaining segments (all 255) are the start of a packet which continues on the next page.
+			if(!stream.has_continued_packet_)
+				stream.continued_packet_.clear();
+			stream.continued_packet_.insert(stream.continued_packet_.end(), buffer_page_.data + page_data_offset_, buffer_page_.data + buffer_page_.data_len);
+			stream.has_continued_packet_ = true;
 		}
-		CHECK(len == 0 && offset == buffer_page_.data_len);
+
+		if(seek_index_builder_)
+			_add_seek_index_entry(stream);
 
 		if(buffer_page_.header.header_type_flag & HeaderFlag_Last) {
 			CHECK(callbacks_.gotEof());
@@ -1482,6 +3126,143 @@ struct OggReader {
 
 		return OkOrError();
 	}
+
+	OkOrError _handle_packet(VorbisStream& stream, VorbisPacket& packet) {
+		if(headers_only_ && stream.packet_counts_ >= 3) {
+			++stream.packet_counts_;
+			return OkOrError();
+		}
+		if(stream.packet_counts_ == 0)
+			CHECK_ERR(packet.parse_id(callbacks_));
+		else if(stream.packet_counts_ == 1)
+			CHECK_ERR(packet.parse_comment(callbacks_));
+		else if(stream.packet_counts_ == 2)
+			CHECK_ERR(packet.parse_setup(callbacks_));
+		else {
+			VorbisStreamDecodeState& state = stream.decode_state;
+			if(!state.skip_packets && state.abs_total_pos >= state.stop_at_pos) {
+				// Behind the requested sample range. No need to decode anything further.
+				range_done_ = true;
+				return OkOrError();
+			}
+			CHECK_ERR(packet.parse_audio(callbacks_));
+			++stream.audio_packet_counts_;
+		}
+		++stream.packet_counts_;
+		++packet_counts_;
+		return OkOrError();
+	}
+};
+
+struct OggVorbisDecoder : ParseCallbacks {
+	// Pull-based decoding: read() decodes lazily only as many packets as needed for the requested frames.
+	// The PCM of a packet which does not fit into the output is kept in pending_,
+	// and returned by the next read().
+	// pending_ is reserved in gotHeader for the max PCM of a packet (blocksize_1 / 2, plus the remainder),
+	// and compacted instead of reallocated, thus there are no allocations in here in steady state.
+	// We only support streams with the same number of channels (e.g. for chained streams).
+	OggReader reader_;
+	std::vector<std::vector<float>> pending_; // per channel
+	size_t pending_pos_;
+	VorbisIdHeader header_;
+	bool has_header_;
+	bool reached_eof_;
+
+	OggVorbisDecoder() : reader_(*this), pending_pos_(0), has_header_(false), reached_eof_(false) {}
+
+	OkOrError open_file(const std::string& filename, bool use_mmap = true) {
+		_clear();
+		return reader_.open_file(filename, use_mmap);
+	}
+
+	OkOrError open_memory(const uint8_t* data, size_t data_len) {
+		_clear();
+		return reader_.set_reader(std::make_shared<ConstDataReader>(data, data_len));
+	}
+
+	OkOrError set_reader(const std::shared_ptr<IReader>& reader) {
+		_clear();
+		return reader_.set_reader(reader);
+	}
+
+	// Decodes the headers, if not done yet. Afterwards, header() and channels() are valid.
+	OkOrError read_headers() {
+		while(!has_header_ && !reached_eof_)
+			CHECK_ERR(reader_.read_next_packet(reached_eof_));
+		CHECK(has_header_);
+		return OkOrError();
+	}
+
+	const VorbisIdHeader& header() const { return header_; }
+	uint8_t channels() const { return has_header_ ? header_.audio_channels : 0; }
+
+	// out[c] must have space for max_frames, for each of the channels().
+	// num_frames is less than max_frames only at the end of the stream (or the sample range).
+	OkOrError read(float** out, size_t max_frames, size_t& num_frames) {
+		num_frames = 0;
+		while(true) {
+			size_t avail = pending_.empty() ? 0 : pending_[0].size() - pending_pos_;
+			size_t n = std::min(avail, max_frames - num_frames);
+			if(n > 0) {
+				for(size_t c = 0; c < pending_.size(); ++c)
+					memcpy(out[c] + num_frames, pending_[c].data() + pending_pos_, n * sizeof(float));
+				pending_pos_ += n;
+				num_frames += n;
+			}
+			if(num_frames >= max_frames || reached_eof_)
+				break;
+			CHECK_ERR(reader_.read_next_packet(reached_eof_));
+			if(reader_.range_done_)
+				reached_eof_ = true;
+			if(reached_eof_)
+				CHECK_ERR(reader_.crc_verifier_.finish());
+		}
+		return OkOrError();
+	}
+
+	// See OggReader::seek_to_sample(). The next read() starts exactly at the given sample.
+	OkOrError seek_to_sample(uint64_t sample_pos) {
+		_clear_pending();
+		reached_eof_ = false;
+		return reader_.seek_to_sample(sample_pos);
+	}
+
+	void _clear_pending() {
+		for(std::vector<float>& channel : pending_)
+			channel.clear();
+		pending_pos_ = 0;
+	}
+
+	void _clear() {
+		_clear_pending();
+		has_header_ = false;
+		reached_eof_ = false;
+	}
+
+	virtual bool gotHeader(const VorbisIdHeader& header) {
+		if(has_header_ && header.audio_channels != header_.audio_channels)
+			return false;
+		header_ = header;
+		has_header_ = true;
+		size_t capacity = header.get_blocksize_1();
+		pending_.resize(header.audio_channels);
+		for(std::vector<float>& channel : pending_)
+			channel.reserve(capacity);
+		return true;
+	}
+
+	virtual bool gotPcmData(const std::vector<DataRange<const float>>& channelPcms) {
+		if(channelPcms.size() != pending_.size())
+			return false;
+		for(size_t c = 0; c < pending_.size(); ++c) {
+			std::vector<float>& channel = pending_[c];
+			if(pending_pos_ > 0) // compact, to keep within the reserved capacity
+				channel.erase(channel.begin(), channel.begin() + pending_pos_);
+			channel.insert(channel.end(), channelPcms[c].begin(), channelPcms[c].end());
+		}
+		pending_pos_ = 0;
+		return true;
+	}
 };
 
 
@@ -1491,6 +3272,25 @@ extern "C" {
 	// Returns 0 if succeeded.
 	int ogg_vorbis_full_read(const char* filename, const char** error_out);
 	int ogg_vorbis_full_read_from_memory(const char* data, size_t data_len, const char** error_out);
+	// crc_check is one of CrcCheck (0: verify, 1: verify lazily, 2: skip).
+	int ogg_vorbis_full_read_from_memory_ex(const char* data, size_t data_len, int crc_check, const char** error_out);
+
+	struct OggVorbisProbeInfo {
+		uint32_t sample_rate;
+		uint32_t channels;
+		int64_t num_samples; // end granule pos minus the start granule pos, see OggReader::ProbeInfo
+	};
+	// Only parses the headers and the last page. Returns 0 if succeeded.
+	int ogg_vorbis_probe(const char* filename, struct OggVorbisProbeInfo* info_out, const char** error_out);
+	int ogg_vorbis_probe_from_memory(const char* data, size_t data_len, struct OggVorbisProbeInfo* info_out, const char** error_out);
+
+	// Decodes into the interleaved buffer out, with space for max_frames, in the given format
+	// (PcmFormat: 0: float32, 1: int16, 2: int24 in int32). dither (TPDF) only applies to the int formats.
+	// It is an error if the buffer is too small. See ogg_vorbis_probe for the number of frames.
+	// Returns 0 if succeeded.
+	int ogg_vorbis_decode_interleaved_from_memory(
+		const char* data, size_t data_len, int format, int dither,
+		void* out, size_t max_frames, size_t* num_frames_out, const char** error_out);
 }
 
 #endif /* ParseOggVorbis_h */
@@ -0,0 +1,462 @@
+//
+//  Simd.cpp
+//  ParseOggVorbis
+//
+
+#include "Simd.hpp"
+#include <math.h>
+#include <string.h>
+
+
+void simd_mul_add_scalar(float* buf, const float* pcm, const float* win, size_t n) {
+	for(size_t i = 0; i < n; ++i)
+		buf[i] += pcm[i] * win[i];
+}
+
+void simd_add_scalar(float* buf, const float* pcm, size_t n) {
+	for(size_t i = 0; i < n; ++i)
+		buf[i] += pcm[i];
+}
+
+void simd_mul_add_x4_scalar(float* const* bufs, size_t num_bufs, const float* pcm4, const float* win, size_t n) {
+	for(size_t c = 0; c < num_bufs; ++c)
+		for(size_t i = 0; i < n; ++i)
+			bufs[c][i] += pcm4[i * 4 + c] * win[i];
+}
+
+void simd_add_x4_scalar(float* const* bufs, size_t num_bufs, const float* pcm4, size_t n) {
+	for(size_t c = 0; c < num_bufs; ++c)
+		for(size_t i = 0; i < n; ++i)
+			bufs[c][i] += pcm4[i * 4 + c];
+}
+
+void simd_inverse_coupling_scalar(float* mag, float* ang, size_t n) {
+	for(size_t j = 0; j < n; ++j) {
+		float mag_val = mag[j];
+		float ang_val = ang[j];
+		float mag_val_new = mag_val, ang_val_new = ang_val;
+		if(mag_val > 0) {
+			if(ang_val > 0) {
+				ang_val_new = mag_val - ang_val;
+			} else {
+				ang_val_new = mag_val;
+				mag_val_new = mag_val + ang_val;
+			}
+		} else {
+			if(ang_val > 0) {
+				ang_val_new = mag_val + ang_val;
+			} else {
+				ang_val_new = mag_val;
+				mag_val_new = mag_val - ang_val;
+			}
+		}
+		mag[j] = mag_val_new;
+		ang[j] = ang_val_new;
+	}
+}
+
+void simd_lsp_curve_scalar(float* out, const float* w, size_t n, const float* lsp, size_t m) {
+	for(size_t i = 0; i < n; ++i) {
+		float wi = w[i];
+		float p = .5f, q = .5f;
+		size_t j = 1;
+		for(; j < m; j += 2) {
+			q *= wi - lsp[j - 1];
+			p *= wi - lsp[j];
+		}
+		if(j == m) { // odd order, the last coefficient
+			q *= wi - lsp[j - 1];
+			p *= p * (4.f - wi * wi);
+			q *= q;
+		} else {
+			p *= p * (2.f - wi);
+			q *= q * (2.f + wi);
+		}
+		out[i] = p + q;
+	}
+}
+
+SimdDither::SimdDither(uint32_t seed) {
+	for(int i = 0; i < 4; ++i) {
+		// Any non-zero state is fine for xorshift.
+		state[i] = (seed + uint32_t(i)) * 2654435761u;
+		if(!state[i]) state[i] = 1;
+	}
+}
+
+static inline uint32_t xorshift32(uint32_t& x) {
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+// Uniform in [0, 1), from the upper 23 bits.
+static inline float uniform_from_bits(uint32_t x) {
+	uint32_t bits = (x >> 9) | 0x3f800000u;
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f - 1.f;
+}
+
+// The next 4 dither values, in (-1, 1).
+static inline void dither_next4(SimdDither* dither, float out[4]) {
+	for(int i = 0; i < 4; ++i) {
+		float a = uniform_from_bits(xorshift32(dither->state[i]));
+		float b = uniform_from_bits(xorshift32(dither->state[i]));
+		out[i] = a - b;
+	}
+}
+
+template<typename T>
+static void float_to_int_scalar(T* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither, float scale, float lo, float hi) {
+	float d[4] = {0, 0, 0, 0};
+	for(size_t i = 0; i < n; ++i) {
+		if(dither && i % 4 == 0)
+			dither_next4(dither, d);
+		float x = src[i] * scale + d[i % 4];
+		// Like the SSE max/min: NaN gives lo.
+		x = (x > lo) ? x : lo;
+		x = (x < hi) ? x : hi;
+		dst[i * dst_stride] = (T) lrintf(x);
+	}
+}
+
+void simd_float_to_int16_scalar(int16_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither) {
+	float_to_int_scalar(dst, dst_stride, src, n, dither, 32768.f, -32768.f, 32767.f);
+}
+
+void simd_float_to_int24_scalar(int32_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither) {
+	float_to_int_scalar(dst, dst_stride, src, n, dither, 8388608.f, -8388608.f, 8388607.f);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+// SSE2 is always available on x86-64, thus no runtime check for it.
+
+void simd_mul_add_sse2(float* buf, const float* pcm, const float* win, size_t n) {
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(pcm + i), _mm_loadu_ps(win + i));
+		_mm_storeu_ps(buf + i, _mm_add_ps(_mm_loadu_ps(buf + i), x));
+	}
+	simd_mul_add_scalar(buf + i, pcm + i, win + i, n - i);
+}
+
+void simd_add_sse2(float* buf, const float* pcm, size_t n) {
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4)
+		_mm_storeu_ps(buf + i, _mm_add_ps(_mm_loadu_ps(buf + i), _mm_loadu_ps(pcm + i)));
+	simd_add_scalar(buf + i, pcm + i, n - i);
+}
+
+// 4 frames of the 4 interleaved channels, transposed such that x[c] are the 4 frames of channel c.
+static inline void load_transposed_x4(__m128 x[4], const float* pcm4) {
+	x[0] = _mm_loadu_ps(pcm4);
+	x[1] = _mm_loadu_ps(pcm4 + 4);
+	x[2] = _mm_loadu_ps(pcm4 + 8);
+	x[3] = _mm_loadu_ps(pcm4 + 12);
+	_MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+}
+
+void simd_mul_add_x4_sse2(float* const* bufs, size_t num_bufs, const float* pcm4, const float* win, size_t n) {
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128 x[4];
+		load_transposed_x4(x, pcm4 + i * 4);
+		__m128 w = _mm_loadu_ps(win + i);
+		for(size_t c = 0; c < num_bufs; ++c)
+			_mm_storeu_ps(bufs[c] + i, _mm_add_ps(_mm_loadu_ps(bufs[c] + i), _mm_mul_ps(x[c], w)));
+	}
+	if(i < n) {
+		float* rest[4];
+		for(size_t c = 0; c < num_bufs; ++c)
+			rest[c] = bufs[c] + i;
+		simd_mul_add_x4_scalar(rest, num_bufs, pcm4 + i * 4, win + i, n - i);
+	}
+}
+
+void simd_add_x4_sse2(float* const* bufs, size_t num_bufs, const float* pcm4, size_t n) {
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128 x[4];
+		load_transposed_x4(x, pcm4 + i * 4);
+		for(size_t c = 0; c < num_bufs; ++c)
+			_mm_storeu_ps(bufs[c] + i, _mm_add_ps(_mm_loadu_ps(bufs[c] + i), x[c]));
+	}
+	if(i < n) {
+		float* rest[4];
+		for(size_t c = 0; c < num_bufs; ++c)
+			rest[c] = bufs[c] + i;
+		simd_add_x4_scalar(rest, num_bufs, pcm4 + i * 4, n - i);
+	}
+}
+
+// The four cases of the inverse coupling, without branches, via compare masks and blends:
+// if ang > 0: ang' = (mag > 0) ? mag - ang : mag + ang, mag' = mag
+// else: ang' = mag, mag' = (mag > 0) ? mag + ang : mag - ang
+// This does the same operations as the scalar code, thus it is bit-exact, even for NaN payloads.
+void simd_inverse_coupling_sse2(float* mag, float* ang, size_t n) {
+	const __m128 zero = _mm_setzero_ps();
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128 m = _mm_loadu_ps(mag + i);
+		__m128 a = _mm_loadu_ps(ang + i);
+		__m128 mpos = _mm_cmpgt_ps(m, zero);
+		__m128 apos = _mm_cmpgt_ps(a, zero);
+		__m128 sum = _mm_add_ps(m, a);
+		__m128 diff = _mm_sub_ps(m, a);
+		__m128 ang_new = _mm_or_ps(_mm_and_ps(mpos, diff), _mm_andnot_ps(mpos, sum));
+		__m128 mag_new = _mm_or_ps(_mm_and_ps(mpos, sum), _mm_andnot_ps(mpos, diff));
+		_mm_storeu_ps(ang + i, _mm_or_ps(_mm_and_ps(apos, ang_new), _mm_andnot_ps(apos, m)));
+		_mm_storeu_ps(mag + i, _mm_or_ps(_mm_and_ps(apos, m), _mm_andnot_ps(apos, mag_new)));
+	}
+	simd_inverse_coupling_scalar(mag + i, ang + i, n - i);
+}
+
+__attribute__((target("avx")))
+void simd_mul_add_avx(float* buf, const float* pcm, const float* win, size_t n) {
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		// Separate mul and add, not FMA, to round exactly like the scalar code.
+		__m256 x = _mm256_mul_ps(_mm256_loadu_ps(pcm + i), _mm256_loadu_ps(win + i));
+		_mm256_storeu_ps(buf + i, _mm256_add_ps(_mm256_loadu_ps(buf + i), x));
+	}
+	simd_mul_add_sse2(buf + i, pcm + i, win + i, n - i);
+}
+
+__attribute__((target("avx")))
+void simd_add_avx(float* buf, const float* pcm, size_t n) {
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(buf + i, _mm256_add_ps(_mm256_loadu_ps(buf + i), _mm256_loadu_ps(pcm + i)));
+	simd_add_sse2(buf + i, pcm + i, n - i);
+}
+
+__attribute__((target("avx")))
+void simd_inverse_coupling_avx(float* mag, float* ang, size_t n) {
+	const __m256 zero = _mm256_setzero_ps();
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		__m256 m = _mm256_loadu_ps(mag + i);
+		__m256 a = _mm256_loadu_ps(ang + i);
+		__m256 mpos = _mm256_cmp_ps(m, zero, _CMP_GT_OQ);
+		__m256 apos = _mm256_cmp_ps(a, zero, _CMP_GT_OQ);
+		__m256 sum = _mm256_add_ps(m, a);
+		__m256 diff = _mm256_sub_ps(m, a);
+		__m256 ang_new = _mm256_blendv_ps(sum, diff, mpos);
+		__m256 mag_new = _mm256_blendv_ps(diff, sum, mpos);
+		_mm256_storeu_ps(ang + i, _mm256_blendv_ps(m, ang_new, apos));
+		_mm256_storeu_ps(mag + i, _mm256_blendv_ps(mag_new, m, apos));
+	}
+	simd_inverse_coupling_sse2(mag + i, ang + i, n - i);
+}
+
+// The lanes are independent curve points, the products over the coefficients are in the same order as in the scalar code.
+void simd_lsp_curve_sse2(float* out, const float* w, size_t n, const float* lsp, size_t m) {
+	const __m128 two = _mm_set1_ps(2.f);
+	const __m128 four = _mm_set1_ps(4.f);
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128 wi = _mm_loadu_ps(w + i);
+		__m128 p = _mm_set1_ps(.5f), q = p;
+		size_t j = 1;
+		for(; j < m; j += 2) {
+			q = _mm_mul_ps(q, _mm_sub_ps(wi, _mm_set1_ps(lsp[j - 1])));
+			p = _mm_mul_ps(p, _mm_sub_ps(wi, _mm_set1_ps(lsp[j])));
+		}
+		if(j == m) {
+			q = _mm_mul_ps(q, _mm_sub_ps(wi, _mm_set1_ps(lsp[j - 1])));
+			p = _mm_mul_ps(p, _mm_mul_ps(p, _mm_sub_ps(four, _mm_mul_ps(wi, wi))));
+			q = _mm_mul_ps(q, q);
+		} else {
+			p = _mm_mul_ps(p, _mm_mul_ps(p, _mm_sub_ps(two, wi)));
+			q = _mm_mul_ps(q, _mm_mul_ps(q, _mm_add_ps(two, wi)));
+		}
+		_mm_storeu_ps(out + i, _mm_add_ps(p, q));
+	}
+	simd_lsp_curve_scalar(out + i, w + i, n - i, lsp, m);
+}
+
+__attribute__((target("avx")))
+void simd_lsp_curve_avx(float* out, const float* w, size_t n, const float* lsp, size_t m) {
+	const __m256 two = _mm256_set1_ps(2.f);
+	const __m256 four = _mm256_set1_ps(4.f);
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		__m256 wi = _mm256_loadu_ps(w + i);
+		__m256 p = _mm256_set1_ps(.5f), q = p;
+		size_t j = 1;
+		for(; j < m; j += 2) {
+			q = _mm256_mul_ps(q, _mm256_sub_ps(wi, _mm256_set1_ps(lsp[j - 1])));
+			p = _mm256_mul_ps(p, _mm256_sub_ps(wi, _mm256_set1_ps(lsp[j])));
+		}
+		if(j == m) {
+			q = _mm256_mul_ps(q, _mm256_sub_ps(wi, _mm256_set1_ps(lsp[j - 1])));
+			p = _mm256_mul_ps(p, _mm256_mul_ps(p, _mm256_sub_ps(four, _mm256_mul_ps(wi, wi))));
+			q = _mm256_mul_ps(q, q);
+		} else {
+			p = _mm256_mul_ps(p, _mm256_mul_ps(p, _mm256_sub_ps(two, wi)));
+			q = _mm256_mul_ps(q, _mm256_mul_ps(q, _mm256_add_ps(two, wi)));
+		}
+		_mm256_storeu_ps(out + i, _mm256_add_ps(p, q));
+	}
+	simd_lsp_curve_sse2(out + i, w + i, n - i, lsp, m);
+}
+
+// SSE2 variant of dither_next4.
+static inline __m128 dither_next4_sse2(__m128i& state) {
+	__m128 one = _mm_set1_ps(1.f);
+	__m128i exp_one = _mm_set1_epi32(0x3f800000);
+	__m128 u[2];
+	for(int k = 0; k < 2; ++k) {
+		state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+		state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+		state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+		u[k] = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(state, 9), exp_one)), one);
+	}
+	return _mm_sub_ps(u[0], u[1]);
+}
+
+// Scaled, dithered, clamped and rounded (nearest even, the default MXCSR rounding, like lrintf).
+template<typename T>
+static void float_to_int_sse2(T* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither, float scale, float lo, float hi) {
+	const __m128 scale_ = _mm_set1_ps(scale), lo_ = _mm_set1_ps(lo), hi_ = _mm_set1_ps(hi);
+	__m128i state = dither ? _mm_loadu_si128((const __m128i*) dither->state) : _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(src + i), scale_);
+		if(dither)
+			x = _mm_add_ps(x, dither_next4_sse2(state));
+		x = _mm_min_ps(_mm_max_ps(x, lo_), hi_);
+		__m128i v = _mm_cvtps_epi32(x);
+		if(sizeof(T) == 2 && dst_stride == 1) {
+			_mm_storel_epi64((__m128i*) (dst + i), _mm_packs_epi32(v, v));
+		}
+		else if(sizeof(T) == 4 && dst_stride == 1) {
+			_mm_storeu_si128((__m128i*) (dst + i), v);
+		}
+		else {
+			int32_t tmp[4];
+			_mm_storeu_si128((__m128i*) tmp, v);
+			for(int k = 0; k < 4; ++k)
+				dst[(i + k) * dst_stride] = (T) tmp[k];
+		}
+	}
+	if(dither)
+		_mm_storeu_si128((__m128i*) dither->state, state);
+	float_to_int_scalar(dst + i * dst_stride, dst_stride, src + i, n - i, dither, scale, lo, hi);
+}
+
+void simd_float_to_int16_sse2(int16_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither) {
+	float_to_int_sse2(dst, dst_stride, src, n, dither, 32768.f, -32768.f, 32767.f);
+}
+
+void simd_float_to_int24_sse2(int32_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither) {
+	float_to_int_sse2(dst, dst_stride, src, n, dither, 8388608.f, -8388608.f, 8388607.f);
+}
+
+bool simd_avx_supported() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+}
+
+#else
+
+void simd_mul_add_sse2(float* buf, const float* pcm, const float* win, size_t n) {
+	simd_mul_add_scalar(buf, pcm, win, n);
+}
+
+void simd_add_sse2(float* buf, const float* pcm, size_t n) {
+	simd_add_scalar(buf, pcm, n);
+}
+
+void simd_mul_add_avx(float* buf, const float* pcm, const float* win, size_t n) {
+	simd_mul_add_sse2(buf, pcm, win, n);
+}
+
+void simd_mul_add_x4_sse2(float* const* bufs, size_t num_bufs, const float* pcm4, const float* win, size_t n) {
+	simd_mul_add_x4_scalar(bufs, num_bufs, pcm4, win, n);
+}
+
+void simd_add_x4_sse2(float* const* bufs, size_t num_bufs, const float* pcm4, size_t n) {
+	simd_add_x4_scalar(bufs, num_bufs, pcm4, n);
+}
+
+void simd_inverse_coupling_sse2(float* mag, float* ang, size_t n) {
+	simd_inverse_coupling_scalar(mag, ang, n);
+}
+
+void simd_inverse_coupling_avx(float* mag, float* ang, size_t n) {
+	simd_inverse_coupling_sse2(mag, ang, n);
+}
+
+void simd_add_avx(float* buf, const float* pcm, size_t n) {
+	simd_add_sse2(buf, pcm, n);
+}
+
+void simd_lsp_curve_sse2(float* out, const float* w, size_t n, const float* lsp, size_t m) {
+	simd_lsp_curve_scalar(out, w, n, lsp, m);
+}
+
+void simd_lsp_curve_avx(float* out, const float* w, size_t n, const float* lsp, size_t m) {
+	simd_lsp_curve_sse2(out, w, n, lsp, m);
+}
+
+void simd_float_to_int16_sse2(int16_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither) {
+	simd_float_to_int16_scalar(dst, dst_stride, src, n, dither);
+}
+
+void simd_float_to_int24_sse2(int32_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither) {
+	simd_float_to_int24_scalar(dst, dst_stride, src, n, dither);
+}
+
+bool simd_avx_supported() {
+	return false;
+}
+
+#endif
+
+typedef void (*SimdMulAddFunc)(float* buf, const float* pcm, const float* win, size_t n);
+typedef void (*SimdAddFunc)(float* buf, const float* pcm, size_t n);
+typedef void (*SimdInverseCouplingFunc)(float* mag, float* ang, size_t n);
+typedef void (*SimdLspCurveFunc)(float* out, const float* w, size_t n, const float* lsp, size_t m);
+
+void simd_mul_add(float* buf, const float* pcm, const float* win, size_t n) {
+	static const SimdMulAddFunc func = simd_avx_supported() ? simd_mul_add_avx : simd_mul_add_sse2;
+	func(buf, pcm, win, n);
+}
+
+void simd_add(float* buf, const float* pcm, size_t n) {
+	static const SimdAddFunc func = simd_avx_supported() ? simd_add_avx : simd_add_sse2;
+	func(buf, pcm, n);
+}
+
+void simd_inverse_coupling(float* mag, float* ang, size_t n) {
+	static const SimdInverseCouplingFunc func = simd_avx_supported() ? simd_inverse_coupling_avx : simd_inverse_coupling_sse2;
+	func(mag, ang, n);
+}
+
+void simd_lsp_curve(float* out, const float* w, size_t n, const float* lsp, size_t m) {
+	static const SimdLspCurveFunc func = simd_avx_supported() ? simd_lsp_curve_avx : simd_lsp_curve_sse2;
+	func(out, w, n, lsp, m);
+}
+
+// SSE2 is always there on x86-64, so no runtime check needed.
+void simd_mul_add_x4(float* const* bufs, size_t num_bufs, const float* pcm4, const float* win, size_t n) {
+	simd_mul_add_x4_sse2(bufs, num_bufs, pcm4, win, n);
+}
+
+void simd_add_x4(float* const* bufs, size_t num_bufs, const float* pcm4, size_t n) {
+	simd_add_x4_sse2(bufs, num_bufs, pcm4, n);
+}
+
+void simd_float_to_int16(int16_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither) {
+	simd_float_to_int16_sse2(dst, dst_stride, src, n, dither);
+}
+
+void simd_float_to_int24(int32_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither) {
+	simd_float_to_int24_sse2(dst, dst_stride, src, n, dither);
+}
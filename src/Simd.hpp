@@ -0,0 +1,67 @@
+//
+//  Simd.hpp
+//  ParseOggVorbis
+//
+//  Vectorized inner loops of the decoder, with runtime CPU dispatch.
+//
+
+#ifndef Simd_h
+#define Simd_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Each uses the best implementation for the CPU, selected at runtime.
+// All implementations give bit-identical results (no FMA, no reordering).
+
+// buf[i] += pcm[i] * win[i]
+void simd_mul_add(float* buf, const float* pcm, const float* win, size_t n);
+// buf[i] += pcm[i]
+void simd_add(float* buf, const float* pcm, size_t n);
+// The same for up to 4 channels at once, from the interleaved output of Mdct::backward_x4:
+// bufs[c][i] += pcm4[i * 4 + c] * win[i] (resp. without the window), for c in [0, num_bufs), num_bufs <= 4.
+void simd_mul_add_x4(float* const* bufs, size_t num_bufs, const float* pcm4, const float* win, size_t n);
+void simd_add_x4(float* const* bufs, size_t num_bufs, const float* pcm4, size_t n);
+// Vorbis inverse coupling (spec 4.3.5), inplace on the magnitude and angle vectors.
+void simd_inverse_coupling(float* mag, float* ang, size_t n);
+// Vorbis floor 0 LSP curve (spec 6.2.3), without the final amplitude step, as in libvorbis vorbis_lsp_to_curve.
+// For w[i] = 2 cos(omega_i) and lsp[j] = 2 cos(coefficient_j), j in [0, m): out[i] = p + q.
+void simd_lsp_curve(float* out, const float* w, size_t n, const float* lsp, size_t m);
+
+// State for TPDF dither, i.e. the sum of two uniform random values, in (-1, 1) LSB.
+// Four xorshift32 generators, one per SIMD lane, such that all implementations give the same sequence.
+struct SimdDither {
+	uint32_t state[4];
+	explicit SimdDither(uint32_t seed = 1);
+};
+
+// Float samples (nominal range [-1, 1]) to int16, or to int24 in int32 (right-aligned, sign-extended).
+// Rounds to nearest and saturates. dst[i * dst_stride] = convert(src[i]) for i in [0, n).
+// If dither is not null, TPDF dither is added before rounding.
+void simd_float_to_int16(int16_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither);
+void simd_float_to_int24(int32_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither);
+
+// The specific implementations. Mostly for testing and benchmarking.
+void simd_mul_add_scalar(float* buf, const float* pcm, const float* win, size_t n);
+void simd_mul_add_sse2(float* buf, const float* pcm, const float* win, size_t n); // falls back to scalar if not compiled in
+void simd_mul_add_avx(float* buf, const float* pcm, const float* win, size_t n); // falls back to sse2 if not compiled in
+void simd_add_scalar(float* buf, const float* pcm, size_t n);
+void simd_add_sse2(float* buf, const float* pcm, size_t n);
+void simd_add_avx(float* buf, const float* pcm, size_t n);
+void simd_mul_add_x4_scalar(float* const* bufs, size_t num_bufs, const float* pcm4, const float* win, size_t n);
+void simd_mul_add_x4_sse2(float* const* bufs, size_t num_bufs, const float* pcm4, const float* win, size_t n);
+void simd_add_x4_scalar(float* const* bufs, size_t num_bufs, const float* pcm4, size_t n);
+void simd_add_x4_sse2(float* const* bufs, size_t num_bufs, const float* pcm4, size_t n);
+void simd_inverse_coupling_scalar(float* mag, float* ang, size_t n); // the reference, as in the spec
+void simd_inverse_coupling_sse2(float* mag, float* ang, size_t n);
+void simd_inverse_coupling_avx(float* mag, float* ang, size_t n);
+void simd_lsp_curve_scalar(float* out, const float* w, size_t n, const float* lsp, size_t m); // the reference
+void simd_lsp_curve_sse2(float* out, const float* w, size_t n, const float* lsp, size_t m);
+void simd_lsp_curve_avx(float* out, const float* w, size_t n, const float* lsp, size_t m);
+void simd_float_to_int16_scalar(int16_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither);
+void simd_float_to_int16_sse2(int16_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither);
+void simd_float_to_int24_scalar(int32_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither);
+void simd_float_to_int24_sse2(int32_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither);
+bool simd_avx_supported();
+
+#endif /* Simd_h */
@@ -8,9 +8,14 @@
 
 #include "Utils.hpp"
 #include "crctable.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 
-uint32_t update_crc(uint32_t crc, uint8_t* buffer, int size) {
+uint32_t update_crc_slicing8(uint32_t crc, const uint8_t* buffer, int size) {
 	while(size >= 8) {
 		crc ^= buffer[0]<<24 | buffer[1]<<16 | buffer[2]<<8 | buffer[3];
 		
@@ -28,3 +33,225 @@ uint32_t update_crc(uint32_t crc, uint8_t* buffer, int size) {
 		crc = (crc<<8) ^ crc_lookup[0][((crc>>24)&0xff) ^ *buffer++];
 	return crc;
 }
+
+namespace {
+
+struct CrcSlicing16Tables {
+	// crc_lookup16[k][b] is the CRC of byte b followed by k zero bytes.
+	// The first 8 are the same as crc_lookup.
+	uint32_t t[16][256];
+	CrcSlicing16Tables() {
+		for(int b = 0; b < 256; ++b)
+			t[0][b] = crc_lookup[0][b];
+		for(int k = 1; k < 16; ++k)
+			for(int b = 0; b < 256; ++b)
+				t[k][b] = (t[k - 1][b] << 8) ^ t[0][t[k - 1][b] >> 24];
+	}
+};
+
+const CrcSlicing16Tables crc_slicing16_tables;
+
+}
+
+uint32_t update_crc_slicing16(uint32_t crc, const uint8_t* buffer, int size) {
+	const uint32_t (*t)[256] = crc_slicing16_tables.t;
+	while(size >= 16) {
+		crc ^= buffer[0]<<24 | buffer[1]<<16 | buffer[2]<<8 | buffer[3];
+		
+		crc =
+		t[15][ crc>>24      ] ^ t[14][(crc>>16)&0xff] ^
+		t[13][(crc>> 8)&0xff] ^ t[12][ crc     &0xff] ^
+		t[11][buffer[4]     ] ^ t[10][buffer[5]     ] ^
+		t[9][buffer[6]      ] ^ t[8][buffer[7]      ] ^
+		t[7][buffer[8]      ] ^ t[6][buffer[9]      ] ^
+		t[5][buffer[10]     ] ^ t[4][buffer[11]     ] ^
+		t[3][buffer[12]     ] ^ t[2][buffer[13]     ] ^
+		t[1][buffer[14]     ] ^ t[0][buffer[15]     ];
+		
+		buffer += 16;
+		size -= 16;
+	}
+	
+	if(size >= 8) {
+		crc ^= buffer[0]<<24 | buffer[1]<<16 | buffer[2]<<8 | buffer[3];
+		
+		crc =
+		t[7][ crc>>24      ] ^ t[6][(crc>>16)&0xff] ^
+		t[5][(crc>> 8)&0xff] ^ t[4][ crc     &0xff] ^
+		t[3][buffer[4]     ] ^ t[2][buffer[5]     ] ^
+		t[1][buffer[6]     ] ^ t[0][buffer[7]     ];
+		
+		buffer += 8;
+		size -= 8;
+	}
+	
+	while(size--)
+		crc = (crc<<8) ^ t[0][((crc>>24)&0xff) ^ *buffer++];
+	return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+namespace {
+
+// x^n mod P, with P = 0x04c11db7 (the Ogg CRC polynomial, non-reflected).
+uint32_t crc_xpow_mod(int n) {
+	uint32_t r = 1;
+	while(n-- > 0)
+		r = (r << 1) ^ ((r & 0x80000000) ? 0x04c11db7 : 0);
+	return r;
+}
+
+struct CrcFoldConstants {
+	// Each fold multiplies the high and the low 64 bits of the 128 bit state
+	// with x^(N+64) mod P and x^N mod P, to shift it N bits further.
+	uint64_t fold512_hi, fold512_lo;
+	uint64_t fold128_hi, fold128_lo;
+	CrcFoldConstants() :
+		fold512_hi(crc_xpow_mod(512 + 64)), fold512_lo(crc_xpow_mod(512)),
+		fold128_hi(crc_xpow_mod(128 + 64)), fold128_lo(crc_xpow_mod(128)) {}
+};
+
+const CrcFoldConstants crc_fold_constants;
+
+__attribute__((target("pclmul,ssse3")))
+inline __m128i crc_load_be(const uint8_t* buffer) {
+	// The first byte has the highest-degree coefficients, so reverse the bytes
+	// such that bit i of the 128 bit register is the coefficient of x^i.
+	const __m128i swap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) buffer), swap);
+}
+
+__attribute__((target("pclmul,ssse3")))
+inline __m128i crc_fold(__m128i x, __m128i k) {
+	// The products are at most 64+32 bits, i.e. no reduction needed here.
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+}
+
+// Folding with carry-less multiplication, see
+// Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+// The final 128 bit remainder is reduced via the table,
+// as CRC(remainder bytes) == (remainder * x^32) mod P, which is what we want.
+__attribute__((target("pclmul,ssse3")))
+uint32_t update_crc_pclmul(uint32_t crc, const uint8_t* buffer, int size) {
+	if(size < 64)
+		return update_crc_slicing16(crc, buffer, size);
+	const __m128i k512 = _mm_set_epi64x((long long) crc_fold_constants.fold512_hi, (long long) crc_fold_constants.fold512_lo);
+	const __m128i k128 = _mm_set_epi64x((long long) crc_fold_constants.fold128_hi, (long long) crc_fold_constants.fold128_lo);
+	__m128i x0 = crc_load_be(buffer);
+	__m128i x1 = crc_load_be(buffer + 16);
+	__m128i x2 = crc_load_be(buffer + 32);
+	__m128i x3 = crc_load_be(buffer + 48);
+	// The initial CRC is xored onto the first 32 bits of the data.
+	x0 = _mm_xor_si128(x0, _mm_set_epi32((int) crc, 0, 0, 0));
+	buffer += 64;
+	size -= 64;
+	while(size >= 64) {
+		x0 = _mm_xor_si128(crc_fold(x0, k512), crc_load_be(buffer));
+		x1 = _mm_xor_si128(crc_fold(x1, k512), crc_load_be(buffer + 16));
+		x2 = _mm_xor_si128(crc_fold(x2, k512), crc_load_be(buffer + 32));
+		x3 = _mm_xor_si128(crc_fold(x3, k512), crc_load_be(buffer + 48));
+		buffer += 64;
+		size -= 64;
+	}
+	x1 = _mm_xor_si128(crc_fold(x0, k128), x1);
+	x2 = _mm_xor_si128(crc_fold(x1, k128), x2);
+	x3 = _mm_xor_si128(crc_fold(x2, k128), x3);
+	while(size >= 16) {
+		x3 = _mm_xor_si128(crc_fold(x3, k128), crc_load_be(buffer));
+		buffer += 16;
+		size -= 16;
+	}
+	uint8_t remainder[16];
+	const __m128i swap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	_mm_storeu_si128((__m128i*) remainder, _mm_shuffle_epi8(x3, swap));
+	crc = update_crc_slicing16(0, remainder, 16);
+	return update_crc_slicing16(crc, buffer, size);
+}
+
+bool crc_pclmul_supported() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+}
+
+#else
+
+uint32_t update_crc_pclmul(uint32_t crc, const uint8_t* buffer, int size) {
+	return update_crc_slicing16(crc, buffer, size);
+}
+
+bool crc_pclmul_supported() {
+	return false;
+}
+
+#endif
+
+typedef uint32_t (*UpdateCrcFunc)(uint32_t crc, const uint8_t* buffer, int size);
+
+static UpdateCrcFunc select_update_crc() {
+	if(crc_pclmul_supported())
+		return update_crc_pclmul;
+	return update_crc_slicing16;
+}
+
+uint32_t update_crc(uint32_t crc, const uint8_t* buffer, int size) {
+	static const UpdateCrcFunc func = select_update_crc();
+	return func(crc, buffer, size);
+}
+
+uint64_t hash_fnv1a(const uint8_t* data, size_t size, uint64_t hash) {
+	for(size_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+MmapReader::MmapReader(const std::string& filename) : ConstDataReader(nullptr, 0), map_(nullptr), map_len_(0) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		err_msg_ = "cannot open file " + filename + ": " + strerror(errno);
+		return;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		err_msg_ = "cannot stat file " + filename + ": " + strerror(errno);
+		close(fd);
+		return;
+	}
+	if(!S_ISREG(st.st_mode)) { // e.g. a pipe, which we cannot map
+		err_msg_ = "cannot mmap file " + filename + ": not a regular file";
+		close(fd);
+		return;
+	}
+	map_len_ = (size_t) st.st_size;
+	if(map_len_ > 0) { // mmap does not allow an empty mapping
+		void* map = mmap(nullptr, map_len_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map == MAP_FAILED) {
+			err_msg_ = "cannot mmap file " + filename + ": " + strerror(errno);
+			map_len_ = 0;
+			close(fd);
+			return;
+		}
+		map_ = map;
+		madvise(map_, map_len_, MADV_SEQUENTIAL);
+	}
+	close(fd); // the mapping stays valid
+	begin_ = data_ = (const uint8_t*) map_;
+	total_len_ = len_ = map_len_;
+}
+
+MmapReader::~MmapReader() {
+	if(map_)
+		munmap(map_, map_len_);
+}
+
+OkOrError MmapReader::isValid() {
+	if(!err_msg_.empty())
+		return OkOrError(err_msg_);
+	return OkOrError();
+}
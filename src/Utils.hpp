@@ -17,6 +17,8 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <new>
+#include <type_traits>
 #ifdef __APPLE__
 #include <machine/endian.h>
 #endif
@@ -27,7 +29,17 @@
 // https://xiph.org/vorbis/doc/Vorbis_I_spec.html
 // Some of the reference functions (9.2) of Vorbis are here.
 
-uint32_t update_crc(uint32_t crc, uint8_t* buffer, int size);
+// Ogg CRC-32 (polynomial 0x04c11db7, not reflected, init 0, no final xor).
+// Uses the fastest implementation for the CPU, selected at runtime.
+uint32_t update_crc(uint32_t crc, const uint8_t* buffer, int size);
+// The specific implementations. Mostly for testing and benchmarking.
+uint32_t update_crc_slicing8(uint32_t crc, const uint8_t* buffer, int size);
+uint32_t update_crc_slicing16(uint32_t crc, const uint8_t* buffer, int size);
+uint32_t update_crc_pclmul(uint32_t crc, const uint8_t* buffer, int size); // falls back to slicing16 if not compiled in
+bool crc_pclmul_supported();
+
+// FNV-1a, 64 bit. Not a cryptographic hash.
+uint64_t hash_fnv1a(const uint8_t* data, size_t size, uint64_t hash = 14695981039346656037ULL);
 
 
 struct OkOrError {
@@ -138,10 +150,10 @@ inline T render_point(T x0, T y0, T x1, T y1, T X) {
 
 // 9.2.7. render_line
 // Assigns vec[x] = y for x in [x0,x1-1], where y is interpolated.
-// We expect vec to be resized beforehand.
+// We expect vec to be resized beforehand. vec can be a std::vector or a DataRange.
 // We allow some x to be outside of the valid range, and will just skip them.
-template<typename T>
-inline void render_line(size_t x0, T y0, size_t x1, T y1, std::vector<T>& vec) {
+template<typename T, typename Vec>
+inline void render_line(size_t x0, T y0, size_t x1, T y1, Vec& vec) {
 	assert(x0 < x1);
 	if(x0 >= vec.size())
 		return;
@@ -259,6 +271,17 @@ struct IReader {
 	virtual OkOrError isValid() = 0;
 	virtual bool reachedEnd() = 0;
 	virtual size_t read(void* ptr, size_t size, size_t nitems) = 0;
+	// Zero-copy access, if the reader has all the data in memory.
+	// If supportsView(), view(size) returns a pointer to the next size bytes and advances,
+	// or nullptr if there are not enough bytes left (and then reachedEnd()).
+	// The pointer stays valid as long as the reader lives.
+	virtual bool supportsView() { return false; }
+	virtual const uint8_t* view(size_t size) { (void) size; return nullptr; }
+	// Random access. Positions are absolute byte offsets. Only valid if isSeekable().
+	virtual bool isSeekable() { return false; }
+	virtual OkOrError seek(uint64_t pos) { (void) pos; return OkOrError("seek not supported"); }
+	virtual uint64_t tell() { return 0; }
+	virtual uint64_t size() { return 0; }
 };
 
 struct FileReader : IReader {
@@ -270,13 +293,32 @@ struct FileReader : IReader {
 	virtual size_t read(void* ptr, size_t size, size_t nitems) override {
 		return fread(ptr, size, nitems, fp_);
 	}
+	virtual bool isSeekable() override {
+		return ftello(fp_) >= 0; // fails e.g. for pipes
+	}
+	virtual OkOrError seek(uint64_t pos) override {
+		CHECK(fseeko(fp_, (off_t) pos, SEEK_SET) == 0);
+		return OkOrError();
+	}
+	virtual uint64_t tell() override {
+		return (uint64_t) ftello(fp_);
+	}
+	virtual uint64_t size() override {
+		off_t pos = ftello(fp_);
+		fseeko(fp_, 0, SEEK_END);
+		off_t end = ftello(fp_);
+		fseeko(fp_, pos, SEEK_SET);
+		return (uint64_t) end;
+	}
 };
 
 struct ConstDataReader : IReader {
-	const uint8_t* data_;
-	size_t len_;
+	const uint8_t* begin_;
+	size_t total_len_;
+	const uint8_t* data_; // current pos
+	size_t len_; // remaining
 	bool reached_end_;
-	ConstDataReader(const uint8_t* data, size_t len) : data_(data), len_(len), reached_end_(false) {}
+	ConstDataReader(const uint8_t* data, size_t len) : begin_(data), total_len_(len), data_(data), len_(len), reached_end_(false) {}
 	virtual OkOrError isValid() override { return OkOrError(); }
 	virtual bool reachedEnd() override { return reached_end_; }
 	virtual size_t read(void* ptr, size_t size, size_t nitems) override {
@@ -289,6 +331,38 @@ struct ConstDataReader : IReader {
 		len_ -= size * nitems;
 		return nitems;
 	}
+	virtual bool supportsView() override { return true; }
+	virtual const uint8_t* view(size_t size) override {
+		if(len_ < size) {
+			reached_end_ = true;
+			return nullptr;
+		}
+		const uint8_t* ptr = data_;
+		data_ += size;
+		len_ -= size;
+		return ptr;
+	}
+	virtual bool isSeekable() override { return true; }
+	virtual OkOrError seek(uint64_t pos) override {
+		CHECK(pos <= total_len_);
+		data_ = begin_ + pos;
+		len_ = total_len_ - (size_t) pos;
+		reached_end_ = false;
+		return OkOrError();
+	}
+	virtual uint64_t tell() override { return (uint64_t) (data_ - begin_); }
+	virtual uint64_t size() override { return total_len_; }
+};
+
+struct MmapReader : ConstDataReader {
+	// Maps the whole file into memory (read-only), with sequential readahead.
+	// Via view(), the data can then be used directly from the mapping without any copy.
+	void* map_;
+	size_t map_len_;
+	std::string err_msg_; // empty if valid
+	MmapReader(const std::string& filename);
+	virtual ~MmapReader();
+	virtual OkOrError isValid() override;
 };
 
 template<int N>
@@ -423,6 +497,85 @@ struct BitReader {
 	uint8_t bitOffset() const { return (8 - last_byte_remaining_bits_) % 8; }
 };
 
+struct PacketBitReader {
+	// Same bit order as BitReader (LSb first), but reads directly from a contiguous buffer (e.g. a packet),
+	// without going through IReader. We keep up to 64 bits in an accumulator, which we refill
+	// from the buffer with a single (unaligned) 64 bit load where possible.
+	// Bits after the end of the buffer read as zero. We allow to reach the end, i.e. this is not an error.
+	const uint8_t* data_; // next byte to load into acc_
+	const uint8_t* end_;
+	uint64_t acc_; // next bit to read is the LSb. bits above acc_bits_ are from data_ (or zero), see refill()
+	int acc_bits_; // number of valid bits in acc_. 0..64
+	size_t bit_pos_; // number of consumed bits
+	size_t bit_len_;
+	PacketBitReader(const uint8_t* data, size_t len) :
+	data_(data), end_(data + len), acc_(0), acc_bits_(0), bit_pos_(0), bit_len_(len * 8) {}
+
+	// Afterwards, there are at least 56 valid bits in acc_ (the fast path gives 56..63, the byte loop 57..64).
+	void refill() {
+		if(end_ - data_ >= 8) {
+			uint64_t w;
+			memcpy(&w, data_, 8);
+			endian_swap_to_little_endian(w);
+			// The bits of w which do not fit into acc_ are exactly the bits of the next not-consumed byte,
+			// so the next refill will OR the same bits in again. Thus we do not need to mask them.
+			acc_ |= w << acc_bits_;
+			data_ += (63 - acc_bits_) >> 3;
+			acc_bits_ |= 56;
+		}
+		else {
+			while(acc_bits_ <= 56) {
+				uint64_t b = (data_ < end_) ? *data_++ : 0;
+				acc_ |= b << acc_bits_;
+				acc_bits_ += 8;
+			}
+		}
+	}
+
+	// num <= 56
+	uint64_t peekBits(int num) {
+		assert(num >= 0 && num <= 56);
+		if(acc_bits_ < num)
+			refill();
+		return acc_ & ((uint64_t(1) << num) - 1);
+	}
+
+	// Only valid after a peekBits() of at least num bits.
+	void consumeBits(int num) {
+		assert(num >= 0 && num <= acc_bits_);
+		acc_ >>= num;
+		acc_bits_ -= num;
+		bit_pos_ += num;
+	}
+
+	template<typename T>
+	T readBits(int num) {
+		assert(num >= 0 && (unsigned int)(num) <= sizeof(T) * 8);
+		if(num <= 32) {
+			uint64_t v = peekBits(num);
+			consumeBits(num);
+			return T(v);
+		}
+		uint64_t lo = readBits<uint64_t>(32);
+		uint64_t hi = readBits<uint64_t>(num - 32);
+		return T(lo | (hi << 32));
+	}
+
+	template<int N>
+	typename IntTypeByNumBits<N>::unsigned_t readBitsT() {
+		typedef typename IntTypeByNumBits<N>::unsigned_t T;
+		return readBits<T>(N);
+	}
+
+	template<int N>
+	typename IntTypeByNumBytes<N>::unsigned_t readBytesT() {
+		return readBitsT<N * 8>();
+	}
+
+	bool reachedEnd() const { return bit_pos_ > bit_len_; }
+	size_t bitPos() const { return bit_pos_; }
+};
+
 template<typename T>
 struct DataRange {
 	T* data_; // not owned
@@ -448,4 +601,61 @@ struct DataRange {
 	size_t size() const { return size_; }
 };
 
+// Bump allocator for temporary buffers, e.g. for the decoding of a packet. reset() releases everything at once.
+// Allocations beyond the capacity go to extra blocks, and the next reset() grows the capacity to the peak usage.
+// So with a reserve() for the expected usage (or after the first use), there are no heap allocations anymore.
+struct ScratchArena {
+	enum { Alignment = 32 }; // enough for any SIMD loads
+	std::vector<uint8_t> block_; // Alignment more than the capacity, for the alignment of the start
+	size_t used_, peak_;
+	std::vector<std::vector<uint8_t>> overflow_blocks_;
+	size_t num_overflows_; // in total, e.g. for tests
+
+	ScratchArena() : used_(0), peak_(0), num_overflows_(0) {}
+
+	size_t capacity() const { return block_.size() > Alignment ? block_.size() - Alignment : 0; }
+
+	// Only when nothing is allocated, i.e. after reset().
+	void reserve(size_t size) {
+		assert(used_ == 0);
+		if(size > capacity())
+			std::vector<uint8_t>(size + Alignment).swap(block_);
+	}
+
+	void reset() {
+		used_ = 0;
+		if(!overflow_blocks_.empty()) {
+			overflow_blocks_.clear();
+			reserve(peak_);
+		}
+	}
+
+	static uint8_t* _align(uint8_t* ptr) {
+		return (uint8_t*) ((uintptr_t(ptr) + Alignment - 1) & ~uintptr_t(Alignment - 1));
+	}
+
+	uint8_t* alloc_bytes(size_t size) {
+		size = (size + Alignment - 1) & ~size_t(Alignment - 1);
+		used_ += size;
+		if(used_ > peak_)
+			peak_ = used_;
+		if(used_ <= capacity())
+			return _align(block_.data()) + used_ - size;
+		++num_overflows_;
+		overflow_blocks_.emplace_back(size + Alignment);
+		return _align(overflow_blocks_.back().data());
+	}
+
+	// Default-initialized, i.e. uninitialized for the basic types.
+	// reset() does not call any destructors.
+	template<typename T>
+	DataRange<T> alloc(size_t n) {
+		static_assert(std::is_trivially_destructible<T>::value, "ScratchArena does not call destructors");
+		T* ptr = (T*) alloc_bytes(n * sizeof(T));
+		for(size_t i = 0; i < n; ++i)
+			new (&ptr[i]) T;
+		return DataRange<T>(ptr, n);
+	}
+};
+
 #endif /* Utils_h */
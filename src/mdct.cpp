@@ -526,6 +526,771 @@ void mdct_backward(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out)
   }
 }
 
+/* SIMD variants of mdct_backward.  They do exactly the same float
+   operations per element as the scalar code above (no FMA, same
+   operands), only on several butterflies / rotations at once, so the
+   output is bit-identical.  The scalar code stays the reference.
+   Selected at runtime, see mdct_backward_best. */
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(MDCT_INTEGERIZED)
+
+#include <immintrin.h>
+
+#define SHUF(a,b,c,d) _MM_SHUFFLE(d,c,b,a) /* lanes in memory order */
+
+/* loads the two trig values T[0],T[1] into the low / high half */
+static inline __m128 load_pair2(const float *lo, const float *hi){
+  __m128 v=_mm_loadl_pi(_mm_setzero_ps(),(const __m64*)lo);
+  return _mm_loadh_pi(v,(const __m64*)hi);
+}
+
+/* mdct_butterfly_generic, one loop iteration (4 complex pairs) at a time.
+   mdct_butterfly_first is the same with trigint=4. */
+static void mdct_butterfly_generic_sse2(const DATA_TYPE *T,
+                                        DATA_TYPE *x,
+                                        int points,
+                                        int trigint){
+  DATA_TYPE *x1        = x          + points      - 8;
+  DATA_TYPE *x2        = x          + (points>>1) - 8;
+
+  do{
+    __m128 a1 = _mm_loadu_ps(x1);
+    __m128 b1 = _mm_loadu_ps(x1+4);
+    __m128 a2 = _mm_loadu_ps(x2);
+    __m128 b2 = _mm_loadu_ps(x2+4);
+    __m128 ra = _mm_sub_ps(a1,a2);
+    __m128 rb = _mm_sub_ps(b1,b2);
+    _mm_storeu_ps(x1,   _mm_add_ps(a1,a2));
+    _mm_storeu_ps(x1+4, _mm_add_ps(b1,b2));
+
+    /* pair k is at x2[2k],x2[2k+1], with the trig values at T+(3-k)*trigint */
+    __m128 r0 = _mm_shuffle_ps(ra,rb,SHUF(0,2,0,2));
+    __m128 r1 = _mm_shuffle_ps(ra,rb,SHUF(1,3,1,3));
+    __m128 ta = load_pair2(T+trigint*3,T+trigint*2);
+    __m128 tb = load_pair2(T+trigint,T);
+    __m128 t0 = _mm_shuffle_ps(ta,tb,SHUF(0,2,0,2));
+    __m128 t1 = _mm_shuffle_ps(ta,tb,SHUF(1,3,1,3));
+
+    __m128 e = _mm_add_ps(_mm_mul_ps(r1,t1),_mm_mul_ps(r0,t0));
+    __m128 o = _mm_sub_ps(_mm_mul_ps(r1,t0),_mm_mul_ps(r0,t1));
+    _mm_storeu_ps(x2,   _mm_unpacklo_ps(e,o));
+    _mm_storeu_ps(x2+4, _mm_unpackhi_ps(e,o));
+
+    T+=trigint*4;
+    x1-=8;
+    x2-=8;
+
+  }while(x2>=x);
+}
+
+/* Two loop iterations of mdct_butterfly_generic at a time.
+   The 256 bit shuffles work per 128 bit lane; the trig values are
+   arranged in the same lane order, and unpack restores memory order. */
+__attribute__((target("avx")))
+static void mdct_butterfly_generic_avx(const DATA_TYPE *T,
+                                       DATA_TYPE *x,
+                                       int points,
+                                       int trigint){
+  DATA_TYPE *x1        = x          + points      - 16;
+  DATA_TYPE *x2        = x          + (points>>1) - 16;
+
+  do{
+    __m256 a1 = _mm256_loadu_ps(x1);
+    __m256 b1 = _mm256_loadu_ps(x1+8);
+    __m256 a2 = _mm256_loadu_ps(x2);
+    __m256 b2 = _mm256_loadu_ps(x2+8);
+    __m256 ra = _mm256_sub_ps(a1,a2);
+    __m256 rb = _mm256_sub_ps(b1,b2);
+    _mm256_storeu_ps(x1,   _mm256_add_ps(a1,a2));
+    _mm256_storeu_ps(x1+8, _mm256_add_ps(b1,b2));
+
+    /* pair k is at x2[2k],x2[2k+1], with the trig values at T+(7-k)*trigint */
+    __m256 r0 = _mm256_shuffle_ps(ra,rb,SHUF(0,2,0,2));
+    __m256 r1 = _mm256_shuffle_ps(ra,rb,SHUF(1,3,1,3));
+    __m256 ta = _mm256_insertf128_ps(_mm256_castps128_ps256(
+                  load_pair2(T+trigint*7,T+trigint*6)),
+                  load_pair2(T+trigint*5,T+trigint*4),1);
+    __m256 tb = _mm256_insertf128_ps(_mm256_castps128_ps256(
+                  load_pair2(T+trigint*3,T+trigint*2)),
+                  load_pair2(T+trigint,T),1);
+    __m256 t0 = _mm256_shuffle_ps(ta,tb,SHUF(0,2,0,2));
+    __m256 t1 = _mm256_shuffle_ps(ta,tb,SHUF(1,3,1,3));
+
+    __m256 e = _mm256_add_ps(_mm256_mul_ps(r1,t1),_mm256_mul_ps(r0,t0));
+    __m256 o = _mm256_sub_ps(_mm256_mul_ps(r1,t0),_mm256_mul_ps(r0,t1));
+    _mm256_storeu_ps(x2,   _mm256_unpacklo_ps(e,o));
+    _mm256_storeu_ps(x2+8, _mm256_unpackhi_ps(e,o));
+
+    T+=trigint*8;
+    x1-=16;
+    x2-=16;
+
+  }while(x2>=x);
+}
+
+typedef void (*mdct_butterfly_generic_func)(const DATA_TYPE *T,
+                                            DATA_TYPE *x,
+                                            int points,
+                                            int trigint);
+
+static void mdct_butterflies_simd(const mdct_lookup *init,
+                                  DATA_TYPE *x,
+                                  int points,
+                                  mdct_butterfly_generic_func generic){
+
+  DATA_TYPE *T=init->trig;
+  int stages=init->log2n-5;
+  int i,j;
+
+  if(--stages>0){
+    generic(T,x,points,4);
+  }
+
+  for(i=1;--stages>0;i++){
+    for(j=0;j<(1<<i);j++)
+      generic(T,x+(points>>i)*j,points>>i,4<<i);
+  }
+
+  for(j=0;j<points;j+=32)
+    mdct_butterfly_32(x+j);
+
+}
+
+/* mdct_bitreverse, two loop iterations (4 gathered pairs) at a time */
+static void mdct_bitreverse_sse2(const mdct_lookup *init,
+                                 DATA_TYPE *x){
+  int        n       = init->n;
+  int       *bit     = init->bitrev;
+  DATA_TYPE *w0      = x;
+  DATA_TYPE *w1      = x = w0+(n>>1);
+  DATA_TYPE *T       = init->trig+n;
+  const __m128 half  = _mm_set1_ps(.5f);
+
+  do{
+    __m128 xa = load_pair2(x+bit[0],x+bit[2]);
+    __m128 ya = load_pair2(x+bit[1],x+bit[3]);
+    __m128 xb = load_pair2(x+bit[4],x+bit[6]);
+    __m128 yb = load_pair2(x+bit[5],x+bit[7]);
+    __m128 x0e = _mm_shuffle_ps(xa,xb,SHUF(0,2,0,2));
+    __m128 x0o = _mm_shuffle_ps(xa,xb,SHUF(1,3,1,3));
+    __m128 x1e = _mm_shuffle_ps(ya,yb,SHUF(0,2,0,2));
+    __m128 x1o = _mm_shuffle_ps(ya,yb,SHUF(1,3,1,3));
+    __m128 ta  = _mm_loadu_ps(T);
+    __m128 tb  = _mm_loadu_ps(T+4);
+    __m128 t0  = _mm_shuffle_ps(ta,tb,SHUF(0,2,0,2));
+    __m128 t1  = _mm_shuffle_ps(ta,tb,SHUF(1,3,1,3));
+
+    __m128 r0  = _mm_sub_ps(x0o,x1o);
+    __m128 r1  = _mm_add_ps(x0e,x1e);
+    __m128 r2  = _mm_add_ps(_mm_mul_ps(r1,t0),_mm_mul_ps(r0,t1));
+    __m128 r3  = _mm_sub_ps(_mm_mul_ps(r1,t1),_mm_mul_ps(r0,t0));
+
+    r0 = _mm_mul_ps(_mm_add_ps(x0o,x1o),half);
+    r1 = _mm_mul_ps(_mm_sub_ps(x0e,x1e),half);
+
+    __m128 p = _mm_add_ps(r0,r2);
+    __m128 q = _mm_add_ps(r1,r3);
+    __m128 s = _mm_sub_ps(r0,r2);
+    __m128 u = _mm_sub_ps(r3,r1);
+
+    w1 -= 8;
+    _mm_storeu_ps(w0,   _mm_unpacklo_ps(p,q));
+    _mm_storeu_ps(w0+4, _mm_unpackhi_ps(p,q));
+    /* w1 gets the pairs in reverse order */
+    __m128 lo = _mm_unpacklo_ps(s,u);
+    __m128 hi = _mm_unpackhi_ps(s,u);
+    _mm_storeu_ps(w1+4, _mm_shuffle_ps(lo,lo,SHUF(2,3,0,1)));
+    _mm_storeu_ps(w1,   _mm_shuffle_ps(hi,hi,SHUF(2,3,0,1)));
+
+    T   += 8;
+    bit += 8;
+    w0  += 8;
+
+  }while(w0<w1);
+}
+
+static inline __m128 reverse4(__m128 v){
+  return _mm_shuffle_ps(v,v,SHUF(3,2,1,0));
+}
+
+static void mdct_backward_simd(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out,
+                               mdct_butterfly_generic_func generic){
+  int n=init->n;
+  int n2=n>>1;
+  int n4=n>>2;
+  const __m128 sign=_mm_set1_ps(-0.f);
+
+  /* rotate, two loop iterations at a time */
+
+  /* The scalar loop reads the odd entries; start one before, to stay within in[0..n2). */
+  const DATA_TYPE *iX = in+n2-16;
+  DATA_TYPE *oX = out+n2+n4;
+  const DATA_TYPE *T  = init->trig+n4;
+
+  do{
+    __m128 ab = _mm_shuffle_ps(_mm_loadu_ps(iX),  _mm_loadu_ps(iX+4), SHUF(1,3,1,3));
+    __m128 cd = _mm_shuffle_ps(_mm_loadu_ps(iX+8),_mm_loadu_ps(iX+12),SHUF(1,3,1,3));
+    __m128 u  = _mm_shuffle_ps(ab,cd,SHUF(0,2,0,2));
+    __m128 v  = _mm_shuffle_ps(ab,cd,SHUF(1,3,1,3));
+    __m128 ta = _mm_loadu_ps(T);
+    __m128 tb = _mm_loadu_ps(T+4);
+    __m128 c  = _mm_shuffle_ps(tb,ta,SHUF(2,0,2,0));
+    __m128 s  = _mm_shuffle_ps(tb,ta,SHUF(3,1,3,1));
+    __m128 a  = _mm_sub_ps(_mm_xor_ps(_mm_mul_ps(v,s),sign),_mm_mul_ps(u,c));
+    __m128 b  = _mm_sub_ps(_mm_mul_ps(u,s),_mm_mul_ps(v,c));
+    oX -= 8;
+    _mm_storeu_ps(oX,  _mm_unpacklo_ps(a,b));
+    _mm_storeu_ps(oX+4,_mm_unpackhi_ps(a,b));
+    iX -= 16;
+    T  += 8;
+  }while(iX>=in);
+
+  iX            = in+n2-16;
+  oX            = out+n2+n4;
+  T             = init->trig+n4;
+
+  do{
+    T -= 8;
+    __m128 ab = _mm_shuffle_ps(_mm_loadu_ps(iX),  _mm_loadu_ps(iX+4), SHUF(0,2,0,2));
+    __m128 cd = _mm_shuffle_ps(_mm_loadu_ps(iX+8),_mm_loadu_ps(iX+12),SHUF(0,2,0,2));
+    __m128 u  = _mm_shuffle_ps(cd,ab,SHUF(2,0,2,0));
+    __m128 v  = _mm_shuffle_ps(cd,ab,SHUF(3,1,3,1));
+    __m128 ta = _mm_loadu_ps(T+4);
+    __m128 tb = _mm_loadu_ps(T);
+    __m128 c  = _mm_shuffle_ps(ta,tb,SHUF(2,0,2,0));
+    __m128 s  = _mm_shuffle_ps(ta,tb,SHUF(3,1,3,1));
+    __m128 a  = _mm_add_ps(_mm_mul_ps(u,s),_mm_mul_ps(v,c));
+    __m128 b  = _mm_sub_ps(_mm_mul_ps(u,c),_mm_mul_ps(v,s));
+    _mm_storeu_ps(oX,  _mm_unpacklo_ps(a,b));
+    _mm_storeu_ps(oX+4,_mm_unpackhi_ps(a,b));
+    iX -= 16;
+    oX += 8;
+  }while(iX>=in);
+
+  mdct_butterflies_simd(init,out+n2,n2,generic);
+  mdct_bitreverse_sse2(init,out);
+
+  /* roatate + window */
+
+  {
+    DATA_TYPE *oX1=out+n2+n4;
+    DATA_TYPE *oX2=out+n2+n4;
+    DATA_TYPE *iX =out;
+    T             =init->trig+n2;
+
+    do{
+      oX1-=4;
+
+      __m128 xa = _mm_loadu_ps(iX);
+      __m128 xb = _mm_loadu_ps(iX+4);
+      __m128 ta = _mm_loadu_ps(T);
+      __m128 tb = _mm_loadu_ps(T+4);
+      __m128 u  = _mm_shuffle_ps(xa,xb,SHUF(0,2,0,2));
+      __m128 v  = _mm_shuffle_ps(xa,xb,SHUF(1,3,1,3));
+      __m128 c  = _mm_shuffle_ps(ta,tb,SHUF(0,2,0,2));
+      __m128 s  = _mm_shuffle_ps(ta,tb,SHUF(1,3,1,3));
+      __m128 p  = _mm_sub_ps(_mm_mul_ps(u,s),_mm_mul_ps(v,c));
+      __m128 q  = _mm_add_ps(_mm_mul_ps(u,c),_mm_mul_ps(v,s));
+      _mm_storeu_ps(oX1,reverse4(p));
+      _mm_storeu_ps(oX2,_mm_xor_ps(q,sign));
+
+      oX2+=4;
+      iX    +=   8;
+      T     +=   8;
+    }while(iX<oX1);
+
+    iX=out+n2+n4;
+    oX1=out+n4;
+    oX2=oX1;
+
+    do{
+      oX1-=4;
+      iX-=4;
+
+      __m128 v = _mm_loadu_ps(iX);
+      _mm_storeu_ps(oX1,v);
+      _mm_storeu_ps(oX2,_mm_xor_ps(reverse4(v),sign));
+
+      oX2+=4;
+    }while(oX2<iX);
+
+    iX=out+n2+n4;
+    oX1=out+n2+n4;
+    oX2=out+n2;
+    do{
+      oX1-=4;
+      _mm_storeu_ps(oX1,reverse4(_mm_loadu_ps(iX)));
+      iX+=4;
+    }while(oX1>oX2);
+  }
+}
+
+void mdct_backward_sse2(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out){
+  mdct_backward_simd(init,in,out,mdct_butterfly_generic_sse2);
+}
+
+void mdct_backward_avx(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out){
+  mdct_backward_simd(init,in,out,mdct_butterfly_generic_avx);
+}
+
+/* Batched mdct_backward over 4 channels, one per SSE lane.  This is
+   the scalar code from above, only with mdct_v4 instead of float, so
+   each lane is bit-identical to mdct_backward of that channel.  The
+   trig values are loaded once for all channels. */
+
+struct mdct_v4 {
+  __m128 v;
+  mdct_v4() {}
+  mdct_v4(__m128 v_) : v(v_) {}
+};
+
+static inline mdct_v4 operator+(mdct_v4 a, mdct_v4 b){ return _mm_add_ps(a.v,b.v); }
+static inline mdct_v4 operator-(mdct_v4 a, mdct_v4 b){ return _mm_sub_ps(a.v,b.v); }
+static inline mdct_v4 operator-(mdct_v4 a){ return _mm_xor_ps(a.v,_mm_set1_ps(-0.f)); }
+static inline mdct_v4 operator*(mdct_v4 a, DATA_TYPE b){ return _mm_mul_ps(a.v,_mm_set1_ps(b)); }
+static inline mdct_v4& operator+=(mdct_v4& a, mdct_v4 b){ a.v=_mm_add_ps(a.v,b.v); return a; }
+
+typedef mdct_v4 V;
+
+/* 8 point butterfly (in place, 4 register) */
+static void mdct4_butterfly_8(V *x){
+  V r0   = x[6] + x[2];
+  V r1   = x[6] - x[2];
+  V r2   = x[4] + x[0];
+  V r3   = x[4] - x[0];
+
+           x[6] = r0   + r2;
+           x[4] = r0   - r2;
+
+           r0   = x[5] - x[1];
+           r2   = x[7] - x[3];
+           x[0] = r1   + r0;
+           x[2] = r1   - r0;
+
+           r0   = x[5] + x[1];
+           r1   = x[7] + x[3];
+           x[3] = r2   + r3;
+           x[1] = r2   - r3;
+           x[7] = r1   + r0;
+           x[5] = r1   - r0;
+
+}
+
+/* 16 point butterfly (in place, 4 register) */
+static void mdct4_butterfly_16(V *x){
+  V r0     = x[1]  - x[9];
+  V r1     = x[0]  - x[8];
+
+           x[8]  += x[0];
+           x[9]  += x[1];
+           x[0]   = MULT_NORM((r0   + r1) * cPI2_8);
+           x[1]   = MULT_NORM((r0   - r1) * cPI2_8);
+
+           r0     = x[3]  - x[11];
+           r1     = x[10] - x[2];
+           x[10] += x[2];
+           x[11] += x[3];
+           x[2]   = r0;
+           x[3]   = r1;
+
+           r0     = x[12] - x[4];
+           r1     = x[13] - x[5];
+           x[12] += x[4];
+           x[13] += x[5];
+           x[4]   = MULT_NORM((r0   - r1) * cPI2_8);
+           x[5]   = MULT_NORM((r0   + r1) * cPI2_8);
+
+           r0     = x[14] - x[6];
+           r1     = x[15] - x[7];
+           x[14] += x[6];
+           x[15] += x[7];
+           x[6]  = r0;
+           x[7]  = r1;
+
+           mdct4_butterfly_8(x);
+           mdct4_butterfly_8(x+8);
+}
+
+/* 32 point butterfly (in place, 4 register) */
+static void mdct4_butterfly_32(V *x){
+  V r0     = x[30] - x[14];
+  V r1     = x[31] - x[15];
+
+           x[30] +=         x[14];
+           x[31] +=         x[15];
+           x[14]  =         r0;
+           x[15]  =         r1;
+
+           r0     = x[28] - x[12];
+           r1     = x[29] - x[13];
+           x[28] +=         x[12];
+           x[29] +=         x[13];
+           x[12]  = MULT_NORM( r0 * cPI1_8  -  r1 * cPI3_8 );
+           x[13]  = MULT_NORM( r0 * cPI3_8  +  r1 * cPI1_8 );
+
+           r0     = x[26] - x[10];
+           r1     = x[27] - x[11];
+           x[26] +=         x[10];
+           x[27] +=         x[11];
+           x[10]  = MULT_NORM(( r0  - r1 ) * cPI2_8);
+           x[11]  = MULT_NORM(( r0  + r1 ) * cPI2_8);
+
+           r0     = x[24] - x[8];
+           r1     = x[25] - x[9];
+           x[24] += x[8];
+           x[25] += x[9];
+           x[8]   = MULT_NORM( r0 * cPI3_8  -  r1 * cPI1_8 );
+           x[9]   = MULT_NORM( r1 * cPI3_8  +  r0 * cPI1_8 );
+
+           r0     = x[22] - x[6];
+           r1     = x[7]  - x[23];
+           x[22] += x[6];
+           x[23] += x[7];
+           x[6]   = r1;
+           x[7]   = r0;
+
+           r0     = x[4]  - x[20];
+           r1     = x[5]  - x[21];
+           x[20] += x[4];
+           x[21] += x[5];
+           x[4]   = MULT_NORM( r1 * cPI1_8  +  r0 * cPI3_8 );
+           x[5]   = MULT_NORM( r1 * cPI3_8  -  r0 * cPI1_8 );
+
+           r0     = x[2]  - x[18];
+           r1     = x[3]  - x[19];
+           x[18] += x[2];
+           x[19] += x[3];
+           x[2]   = MULT_NORM(( r1  + r0 ) * cPI2_8);
+           x[3]   = MULT_NORM(( r1  - r0 ) * cPI2_8);
+
+           r0     = x[0]  - x[16];
+           r1     = x[1]  - x[17];
+           x[16] += x[0];
+           x[17] += x[1];
+           x[0]   = MULT_NORM( r1 * cPI3_8  +  r0 * cPI1_8 );
+           x[1]   = MULT_NORM( r1 * cPI1_8  -  r0 * cPI3_8 );
+
+           mdct4_butterfly_16(x);
+           mdct4_butterfly_16(x+16);
+
+}
+
+/* N point first stage butterfly (in place, 2 register) */
+static void mdct4_butterfly_first(const DATA_TYPE *T,
+                                        V *x,
+                                        int points){
+
+  V *x1        = x          + points      - 8;
+  V *x2        = x          + (points>>1) - 8;
+  V   r0;
+  V   r1;
+
+  do{
+
+               r0      = x1[6]      -  x2[6];
+               r1      = x1[7]      -  x2[7];
+               x1[6]  += x2[6];
+               x1[7]  += x2[7];
+               x2[6]   = MULT_NORM(r1 * T[1]  +  r0 * T[0]);
+               x2[7]   = MULT_NORM(r1 * T[0]  -  r0 * T[1]);
+
+               r0      = x1[4]      -  x2[4];
+               r1      = x1[5]      -  x2[5];
+               x1[4]  += x2[4];
+               x1[5]  += x2[5];
+               x2[4]   = MULT_NORM(r1 * T[5]  +  r0 * T[4]);
+               x2[5]   = MULT_NORM(r1 * T[4]  -  r0 * T[5]);
+
+               r0      = x1[2]      -  x2[2];
+               r1      = x1[3]      -  x2[3];
+               x1[2]  += x2[2];
+               x1[3]  += x2[3];
+               x2[2]   = MULT_NORM(r1 * T[9]  +  r0 * T[8]);
+               x2[3]   = MULT_NORM(r1 * T[8]  -  r0 * T[9]);
+
+               r0      = x1[0]      -  x2[0];
+               r1      = x1[1]      -  x2[1];
+               x1[0]  += x2[0];
+               x1[1]  += x2[1];
+               x2[0]   = MULT_NORM(r1 * T[13] +  r0 * T[12]);
+               x2[1]   = MULT_NORM(r1 * T[12] -  r0 * T[13]);
+
+    x1-=8;
+    x2-=8;
+    T+=16;
+
+  }while(x2>=x);
+}
+
+/* N/stage point generic N stage butterfly (in place, 2 register) */
+static void mdct4_butterfly_generic(const DATA_TYPE *T,
+                                          V *x,
+                                          int points,
+                                          int trigint){
+
+  V *x1        = x          + points      - 8;
+  V *x2        = x          + (points>>1) - 8;
+  V   r0;
+  V   r1;
+
+  do{
+
+               r0      = x1[6]      -  x2[6];
+               r1      = x1[7]      -  x2[7];
+               x1[6]  += x2[6];
+               x1[7]  += x2[7];
+               x2[6]   = MULT_NORM(r1 * T[1]  +  r0 * T[0]);
+               x2[7]   = MULT_NORM(r1 * T[0]  -  r0 * T[1]);
+
+               T+=trigint;
+
+               r0      = x1[4]      -  x2[4];
+               r1      = x1[5]      -  x2[5];
+               x1[4]  += x2[4];
+               x1[5]  += x2[5];
+               x2[4]   = MULT_NORM(r1 * T[1]  +  r0 * T[0]);
+               x2[5]   = MULT_NORM(r1 * T[0]  -  r0 * T[1]);
+
+               T+=trigint;
+
+               r0      = x1[2]      -  x2[2];
+               r1      = x1[3]      -  x2[3];
+               x1[2]  += x2[2];
+               x1[3]  += x2[3];
+               x2[2]   = MULT_NORM(r1 * T[1]  +  r0 * T[0]);
+               x2[3]   = MULT_NORM(r1 * T[0]  -  r0 * T[1]);
+
+               T+=trigint;
+
+               r0      = x1[0]      -  x2[0];
+               r1      = x1[1]      -  x2[1];
+               x1[0]  += x2[0];
+               x1[1]  += x2[1];
+               x2[0]   = MULT_NORM(r1 * T[1]  +  r0 * T[0]);
+               x2[1]   = MULT_NORM(r1 * T[0]  -  r0 * T[1]);
+
+               T+=trigint;
+    x1-=8;
+    x2-=8;
+
+  }while(x2>=x);
+}
+
+static void mdct4_butterflies(const mdct_lookup *init,
+                             V *x,
+                             int points){
+
+  const DATA_TYPE *T=init->trig;
+  int stages=init->log2n-5;
+  int i,j;
+
+  if(--stages>0){
+    mdct4_butterfly_first(T,x,points);
+  }
+
+  for(i=1;--stages>0;i++){
+    for(j=0;j<(1<<i);j++)
+      mdct4_butterfly_generic(T,x+(points>>i)*j,points>>i,4<<i);
+  }
+
+  for(j=0;j<points;j+=32)
+    mdct4_butterfly_32(x+j);
+
+}
+
+static void mdct4_bitreverse(const mdct_lookup *init,
+                            V *x){
+  int        n       = init->n;
+  int       *bit     = init->bitrev;
+  V *w0      = x;
+  V *w1      = x = w0+(n>>1);
+  const DATA_TYPE *T       = init->trig+n;
+
+  do{
+    V *x0    = x+bit[0];
+    V *x1    = x+bit[1];
+
+    V  r0     = x0[1]  - x1[1];
+    V  r1     = x0[0]  + x1[0];
+    V  r2     = MULT_NORM(r1     * T[0]   + r0 * T[1]);
+    V  r3     = MULT_NORM(r1     * T[1]   - r0 * T[0]);
+
+              w1    -= 4;
+
+              r0     = HALVE(x0[1] + x1[1]);
+              r1     = HALVE(x0[0] - x1[0]);
+
+              w0[0]  = r0     + r2;
+              w1[2]  = r0     - r2;
+              w0[1]  = r1     + r3;
+              w1[3]  = r3     - r1;
+
+              x0     = x+bit[2];
+              x1     = x+bit[3];
+
+              r0     = x0[1]  - x1[1];
+              r1     = x0[0]  + x1[0];
+              r2     = MULT_NORM(r1     * T[2]   + r0 * T[3]);
+              r3     = MULT_NORM(r1     * T[3]   - r0 * T[2]);
+
+              r0     = HALVE(x0[1] + x1[1]);
+              r1     = HALVE(x0[0] - x1[0]);
+
+              w0[2]  = r0     + r2;
+              w1[0]  = r0     - r2;
+              w0[3]  = r1     + r3;
+              w1[1]  = r3     - r1;
+
+              T     += 4;
+              bit   += 4;
+              w0    += 4;
+
+  }while(w0<w1);
+}
+
+static void mdct4_backward(const mdct_lookup *init, const V *in, V *out){
+  int n=init->n;
+  int n2=n>>1;
+  int n4=n>>2;
+
+  /* rotate */
+
+  const V *iX = in+n2-7;
+  V *oX = out+n2+n4;
+  const DATA_TYPE *T  = init->trig+n4;
+
+  do{
+    oX         -= 4;
+    oX[0]       = MULT_NORM(-iX[2] * T[3] - iX[0]  * T[2]);
+    oX[1]       = MULT_NORM (iX[0] * T[3] - iX[2]  * T[2]);
+    oX[2]       = MULT_NORM(-iX[6] * T[1] - iX[4]  * T[0]);
+    oX[3]       = MULT_NORM (iX[4] * T[1] - iX[6]  * T[0]);
+    iX         -= 8;
+    T          += 4;
+  }while(iX>=in);
+
+  iX            = in+n2-8;
+  oX            = out+n2+n4;
+  T             = init->trig+n4;
+
+  do{
+    T          -= 4;
+    oX[0]       =  MULT_NORM (iX[4] * T[3] + iX[6] * T[2]);
+    oX[1]       =  MULT_NORM (iX[4] * T[2] - iX[6] * T[3]);
+    oX[2]       =  MULT_NORM (iX[0] * T[1] + iX[2] * T[0]);
+    oX[3]       =  MULT_NORM (iX[0] * T[0] - iX[2] * T[1]);
+    iX         -= 8;
+    oX         += 4;
+  }while(iX>=in);
+
+  mdct4_butterflies(init,out+n2,n2);
+  mdct4_bitreverse(init,out);
+
+  /* roatate + window */
+
+  {
+    V *oX1=out+n2+n4;
+    V *oX2=out+n2+n4;
+    V *iX =out;
+    T             =init->trig+n2;
+
+    do{
+      oX1-=4;
+
+      oX1[3]  =  MULT_NORM (iX[0] * T[1] - iX[1] * T[0]);
+      oX2[0]  = -MULT_NORM (iX[0] * T[0] + iX[1] * T[1]);
+
+      oX1[2]  =  MULT_NORM (iX[2] * T[3] - iX[3] * T[2]);
+      oX2[1]  = -MULT_NORM (iX[2] * T[2] + iX[3] * T[3]);
+
+      oX1[1]  =  MULT_NORM (iX[4] * T[5] - iX[5] * T[4]);
+      oX2[2]  = -MULT_NORM (iX[4] * T[4] + iX[5] * T[5]);
+
+      oX1[0]  =  MULT_NORM (iX[6] * T[7] - iX[7] * T[6]);
+      oX2[3]  = -MULT_NORM (iX[6] * T[6] + iX[7] * T[7]);
+
+      oX2+=4;
+      iX    +=   8;
+      T     +=   8;
+    }while(iX<oX1);
+
+    iX=out+n2+n4;
+    oX1=out+n4;
+    oX2=oX1;
+
+    do{
+      oX1-=4;
+      iX-=4;
+
+      oX2[0] = -(oX1[3] = iX[3]);
+      oX2[1] = -(oX1[2] = iX[2]);
+      oX2[2] = -(oX1[1] = iX[1]);
+      oX2[3] = -(oX1[0] = iX[0]);
+
+      oX2+=4;
+    }while(oX2<iX);
+
+    iX=out+n2+n4;
+    oX1=out+n2+n4;
+    oX2=out+n2;
+    do{
+      oX1-=4;
+      oX1[0]= iX[3];
+      oX1[1]= iX[2];
+      oX1[2]= iX[1];
+      oX1[3]= iX[0];
+      iX+=4;
+    }while(oX1>oX2);
+  }
+}
+
+void mdct_backward_x4(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out){
+  assert(((size_t)in&15)==0 && ((size_t)out&15)==0);
+  mdct4_backward(init,(const V*)in,(V*)out);
+}
+
+int mdct_avx_supported(void){
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx");
+}
+
+#else
+
+void mdct_backward_x4(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out){
+  int n=init->n,i,c;
+  DATA_TYPE *x = (DATA_TYPE*) alloca((n+n/2)*sizeof(*x));
+  DATA_TYPE *y = x+n/2;
+  for(c=0;c<4;c++){
+    for(i=0;i<n/2;i++)x[i]=in[i*4+c];
+    mdct_backward(init,x,y);
+    for(i=0;i<n;i++)out[i*4+c]=y[i];
+  }
+}
+
+void mdct_backward_sse2(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out){
+  mdct_backward(init,in,out);
+}
+
+void mdct_backward_avx(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out){
+  mdct_backward(init,in,out);
+}
+
+int mdct_avx_supported(void){
+  return 0;
+}
+
+#endif
+
+mdct_backward_func mdct_backward_best(void){
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(MDCT_INTEGERIZED)
+  if(mdct_avx_supported())
+    return mdct_backward_avx;
+  return mdct_backward_sse2;
+#else
+  return mdct_backward;
+#endif
+}
+
 void mdct_forward(const mdct_lookup *init, const DATA_TYPE *in, DATA_TYPE *out){
   int n=init->n;
   int n2=n>>1;
@@ -0,0 +1,62 @@
+//
+//  bench_crc.cpp
+//  ParseOggVorbis
+//
+//  Microbenchmark of the CRC implementations.
+//  Build: g++ -O2 -std=c++11 -I src tests/bench_crc.cpp src/Utils.cpp -o bench_crc
+//
+
+#include "Utils.hpp"
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+typedef uint32_t (*UpdateCrcFunc)(uint32_t crc, const uint8_t* buffer, int size);
+
+OkOrError checkSame(const vector<uint8_t>& data) {
+	// Different sizes and alignments, also below the minimal block sizes.
+	for(int offset = 0; offset < 16; ++offset) {
+		for(int size = 0; offset + size <= int(data.size()); size += 1 + size / 4) {
+			uint32_t ref = update_crc_slicing8(uint32_t(size) * 0x9e3779b9, &data[offset], size);
+			CHECK(update_crc_slicing16(uint32_t(size) * 0x9e3779b9, &data[offset], size) == ref);
+			if(crc_pclmul_supported())
+				CHECK(update_crc_pclmul(uint32_t(size) * 0x9e3779b9, &data[offset], size) == ref);
+			CHECK(update_crc(uint32_t(size) * 0x9e3779b9, &data[offset], size) == ref);
+		}
+	}
+	// Check value of the CRC-32 with poly 0x04c11db7, not reflected, init 0, no final xor.
+	const char* check = "123456789";
+	CHECK(update_crc_slicing8(0, (const uint8_t*) check, 9) == 0x89a1897f);
+	return OkOrError();
+}
+
+void bench(const char* name, UpdateCrcFunc func, const vector<uint8_t>& data, int size) {
+	const int total = 1 << 30;
+	int n = total / size;
+	uint32_t crc = 0;
+	auto t0 = chrono::steady_clock::now();
+	for(int i = 0; i < n; ++i)
+		crc = func(crc, &data[0], size);
+	auto t1 = chrono::steady_clock::now();
+	double secs = chrono::duration<double>(t1 - t0).count();
+	cout << name << " size " << size << ": " << (double(n) * size / secs / 1e9) << " GB/s (crc " << hex << crc << dec << ")" << endl;
+}
+
+int main() {
+	vector<uint8_t> data(65536 + 16);
+	uint32_t x = 1;
+	for(size_t i = 0; i < data.size(); ++i) {
+		x = x * 1103515245 + 12345;
+		data[i] = uint8_t(x >> 16);
+	}
+	ASSERT_ERR(checkSame(vector<uint8_t>(data.begin(), data.begin() + 1024)));
+	cout << "pclmul supported: " << crc_pclmul_supported() << endl;
+	for(int size : {27, 255, 4096, 65025}) { // page header, one segment, typical page, max page data
+		bench("slicing8 ", update_crc_slicing8, data, size);
+		bench("slicing16", update_crc_slicing16, data, size);
+		if(crc_pclmul_supported())
+			bench("pclmul   ", update_crc_pclmul, data, size);
+	}
+	return 0;
+}
@@ -45,6 +45,16 @@ def create_debug_out(exec_path, ogg_filename):
     return debug_out_fn
 
 
+class Floor0:
+    def __init__(self, number, order):
+        """
+        :param int number:
+        :param int order:
+        """
+        self.number = number
+        self.order = order
+
+
 class Floor1:
     def __init__(self, number, multiplier, xs):
         """
@@ -112,11 +122,11 @@ class FloorData:
     def __init__(self, channel, floor):
         """
         :param int channel:
-        :param Floor1 floor:
+        :param Floor0|Floor1 floor:
         """
         self.channel = channel
         self.floor = floor
-        self.ys = None  # type: typing.Union[typing.Tuple[int],None]
+        self.ys = None  # type: typing.Union[typing.Tuple[int],typing.Tuple[float],None]  # floor0: the coefficients
 
     @classmethod
     def assert_same(cls, self, other):
@@ -218,7 +228,7 @@ class AudioPacket:
         floor_data = FloorData(channel=channel, floor=floor)
         self.floor_data.append(floor_data)
         name, channel, data = self._read_entry()
-        if name != "floor1 ys":
+        if name != ("floor0 coefficients" if isinstance(floor, Floor0) else "floor1 ys"):
             # It is valid to have an empty floor, i.e. packet without audio.
             self._push_back_entry(name, channel, data)
             return
@@ -259,7 +269,7 @@ class Reader:
         self.decoder_name = self.read_str_expect_key("decoder-name")
         self.decoder_sample_rate = self.read_single_int_expect_key("decoder-sample-rate")
         self.decoder_num_channels = self.read_single_int_expect_key("decoder-num-channels")
-        self.floors = []  # type: typing.List[Floor1]
+        self.floors = []  # type: typing.List[typing.Union[Floor0,Floor1]]
         self.pcm_data = {}  # type: typing.Dict[int, typing.List[typing.Tuple[float, ...]]]
         self.num_samples = {}  # per channel
 
@@ -389,6 +399,11 @@ class Reader:
                 self.dump_entry(name, channel, data)
             if name == "finish_setup":
                 break
+            if name == "floor0_unpack order":
+                order, = data
+                assert isinstance(order, int)
+                self.floors.append(Floor0(number=len(self.floors), order=order))
+                continue
             assert name == "floor1_unpack multiplier"
             multiplier, = data
             assert isinstance(multiplier, int)
@@ -509,6 +524,10 @@ def main():
         reader2.read_setup(dump=args.dump_stdout)
         assert len(reader1.floors) == len(reader2.floors)
         for f1, f2 in zip(reader1.floors, reader2.floors):
+            assert type(f1) == type(f2)
+            if isinstance(f1, Floor0):
+                assert f1.order == f2.order
+                continue
             assert f1.multiplier == f2.multiplier
             assert len(f1.xs) == len(f2.xs)
             for x1, x2 in zip(f1.xs, f2.xs):
@@ -525,7 +544,7 @@ def main():
                 for channel in sorted(reader1.pcm_data.keys()):
                     pcms1 = reader1.pcm_data[channel]
                     pcms2 = reader2.pcm_data[channel]
-                    assert len(pcms1) == len(pcms2)
+                    # Our decoder might return the PCM of a packet in two parts (ring buffer wrap around).
                     pcm1 = sum(pcms1, tuple())
                     pcm2 = sum(pcms2, tuple())
                     min_len = min(len(pcm1), len(pcm2))
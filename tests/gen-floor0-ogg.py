@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+
+"""
+Generates a small synthetic Ogg Vorbis file which uses floor type 0 (LSP) and residue type 1.
+The usual encoders (libvorbis) only produce floor type 1 and residue type 2,
+thus the test files do not cover these. Used to create the test files:
+
+    tests/gen-floor0-ogg.py 1 tests/audio/test.floor0.mono.ogg
+    tests/gen-floor0-ogg.py 4 tests/audio/test.floor0.4ch.ogg
+
+The setup has two floor 0 configurations (orders 5 and 8, with a scalar and a 2-dim VQ book),
+one residue type 1 with a class which has no books (zero partition),
+and four modes (short/long block x floor).
+The audio packets are random, but with LSP coefficients spread evenly over (0, pi) and a moderate amplitude,
+so that the decoded PCM stays in a sane range. Some channels are unused (amplitude 0) in some packets.
+The output is deterministic.
+"""
+
+import sys
+import struct
+import random
+import math
+
+
+def _crc_table():
+    table = []
+    for i in range(256):
+        r = i << 24
+        for _ in range(8):
+            r = ((r << 1) ^ 0x04c11db7) if r & 0x80000000 else (r << 1)
+        table.append(r & 0xffffffff)
+    return table
+
+
+_CrcTable = _crc_table()
+
+
+def ogg_crc(data):
+    crc = 0
+    for x in data:
+        crc = ((crc << 8) & 0xffffffff) ^ _CrcTable[((crc >> 24) & 0xff) ^ x]
+    return crc
+
+
+class BitWriter:
+    """
+    Packs the bits LSb first, as the Vorbis bitpacking convention (spec 2.1).
+    """
+    def __init__(self):
+        self.bits = []
+
+    def write(self, value, num_bits):
+        for i in range(num_bits):
+            self.bits.append((value >> i) & 1)
+
+    def write_codeword(self, entry, length):
+        """
+        With all codewords of the same length, the codeword of an entry is its number.
+        The codeword is read MSb first (spec 3.2.1).
+        """
+        for i in reversed(range(length)):
+            self.write((entry >> i) & 1, 1)
+
+    def write_bytes(self, data):
+        for x in data:
+            self.write(x, 8)
+
+    def get_bytes(self):
+        out = bytearray((len(self.bits) + 7) // 8)
+        for i, b in enumerate(self.bits):
+            if b:
+                out[i // 8] |= 1 << (i % 8)
+        return bytes(out)
+
+
+def float32_unpack_value(mantissa, exp, negative=False):
+    """
+    :return: the packed float (spec 9.2.2) for (-1)**negative * mantissa * 2**exp
+    """
+    return (0x80000000 if negative else 0) | ((exp + 788) << 21) | mantissa
+
+
+BlocksizeExp0, BlocksizeExp1 = 8, 11
+# Floor 0 configurations: order, codebook, bark map size, amplitude offset.
+Floors = [(5, 0, 256, 40), (8, 1, 64, 40)]
+ResidueEnd = 128
+ResiduePartitionSize = 16
+
+
+def write_codebook(w, dims, num_entries, length, lookup=None):
+    """
+    All entries with the same codeword length.
+
+    :param BitWriter w:
+    :param (int,int,int,list[int])|None lookup: min, delta (packed floats), value bits, multiplicands
+    """
+    w.write(0x564342, 24)
+    w.write(dims, 16)
+    w.write(num_entries, 24)
+    w.write(0, 1)  # not ordered
+    w.write(0, 1)  # not sparse
+    for _ in range(num_entries):
+        w.write(length - 1, 5)
+    if lookup is None:
+        w.write(0, 4)
+        return
+    min_value, delta_value, value_bits, multiplicands = lookup
+    w.write(1, 4)
+    w.write(min_value, 32)
+    w.write(delta_value, 32)
+    w.write(value_bits - 1, 4)
+    w.write(0, 1)  # sequence_p
+    for m in multiplicands:
+        w.write(m, value_bits)
+
+
+def id_header(channels):
+    w = BitWriter()
+    w.write(1, 8)
+    w.write_bytes(b"vorbis")
+    w.write(0, 32)  # version
+    w.write(channels, 8)
+    w.write(44100, 32)
+    w.write(0, 32)
+    w.write(0, 32)
+    w.write(0, 32)
+    w.write(BlocksizeExp0, 4)
+    w.write(BlocksizeExp1, 4)
+    w.write(1, 1)
+    return w.get_bytes()
+
+
+def comment_header():
+    w = BitWriter()
+    w.write(3, 8)
+    w.write_bytes(b"vorbis")
+    vendor = b"tests/gen-floor0-ogg.py"
+    w.write(len(vendor), 32)
+    w.write_bytes(vendor)
+    w.write(0, 32)
+    w.write(1, 1)
+    return w.get_bytes()
+
+
+def setup_header():
+    w = BitWriter()
+    w.write(5, 8)
+    w.write_bytes(b"vorbis")
+    # Codebooks.
+    w.write(4 - 1, 8)
+    # 0: scalar floor book, 0.125 + 0.0625 * k.
+    write_codebook(w, 1, 16, 4, (float32_unpack_value(1, -3), float32_unpack_value(1, -4), 4, list(range(16))))
+    # 1: 2-dim floor book, (0.125 * (k % 8), 0.125 * (k // 8)).
+    write_codebook(w, 2, 64, 6, (float32_unpack_value(0, 0), float32_unpack_value(1, -3), 3, list(range(8))))
+    # 2: residue classbook, 2 classes.
+    write_codebook(w, 1, 2, 1)
+    # 3: residue book, -1 + 0.125 * k.
+    write_codebook(w, 1, 16, 4, (float32_unpack_value(1, 0, True), float32_unpack_value(1, -3), 4, list(range(16))))
+    # Time domain transforms (placeholders).
+    w.write(0, 6)
+    w.write(0, 16)
+    # Floors.
+    w.write(len(Floors) - 1, 6)
+    for order, book, bark_map_size, amplitude_offset in Floors:
+        w.write(0, 16)  # type
+        w.write(order, 8)
+        w.write(44100, 16)
+        w.write(bark_map_size, 16)
+        w.write(6, 6)  # amplitude bits
+        w.write(amplitude_offset, 8)
+        w.write(0, 4)  # one book
+        w.write(book, 8)
+    # Residues.
+    w.write(0, 6)
+    w.write(1, 16)  # type
+    w.write(0, 24)
+    w.write(ResidueEnd, 24)
+    w.write(ResiduePartitionSize - 1, 24)
+    w.write(2 - 1, 6)  # classifications
+    w.write(2, 8)  # classbook
+    # Class 0: book 3 in pass 0. Class 1: no books.
+    w.write(1, 3)
+    w.write(0, 1)
+    w.write(0, 3)
+    w.write(0, 1)
+    w.write(3, 8)
+    # Mappings: one per floor, single submap, no coupling.
+    w.write(len(Floors) - 1, 6)
+    for floor in range(len(Floors)):
+        w.write(0, 16)
+        w.write(0, 1)
+        w.write(0, 1)
+        w.write(0, 2)
+        w.write(0, 8)
+        w.write(floor, 8)
+        w.write(0, 8)
+    # Modes: (blockflag, mapping).
+    w.write(4 - 1, 6)
+    for blockflag, mapping in [(0, 0), (1, 0), (0, 1), (1, 1)]:
+        w.write(blockflag, 1)
+        w.write(0, 16)
+        w.write(0, 16)
+        w.write(mapping, 8)
+    w.write(1, 1)
+    return w.get_bytes()
+
+
+def write_lsp_coefficients(w, rnd, order, book):
+    """
+    Near the evenly spaced LSP frequencies pi * (j + 1) / (order + 1), i.e. a mostly flat floor curve.
+    Frequencies which get close to each other would give huge peaks (up to inf) in the curve.
+    The coefficients of a vector are added to the last coefficient of the previous vector (spec 6.2.2).
+    """
+    targets = [math.pi * (j + 1) / (order + 1) + rnd.uniform(-0.05, 0.05) for j in range(order)]
+    last = 0.
+    if book == 0:  # 0.125 + 0.0625 * k
+        for target in targets:
+            k = min(max(int(round((target - last - 0.125) / 0.0625)), 0), 15)
+            w.write_codeword(k, 4)
+            last += 0.125 + 0.0625 * k
+    else:  # (0.125 * (k % 8), 0.125 * (k // 8))
+        for j in range(0, order, 2):
+            k0, k1 = [min(max(int(round((target - last) / 0.125)), 0), 7) for target in targets[j:j + 2]]
+            w.write_codeword(k0 + 8 * k1, 6)
+            last += 0.125 * k1
+
+
+def audio_packet(rnd, channels, mode, prev_blockflag, next_blockflag):
+    w = BitWriter()
+    w.write(0, 1)
+    w.write(mode, 2)
+    blockflag = mode & 1
+    if blockflag:
+        w.write(prev_blockflag, 1)
+        w.write(next_blockflag, 1)
+    order, book, _, _ = Floors[mode >> 1]
+    used = []
+    for _ in range(channels):
+        amplitude = 0 if rnd.random() < 0.15 else rnd.randrange(20, 46)
+        w.write(amplitude, 6)
+        used.append(amplitude > 0)
+        if not amplitude:
+            continue
+        w.write(0, 1)  # book number, ilog(1) bits
+        write_lsp_coefficients(w, rnd, order, book)
+    # Residue type 1, one classword per partition and channel.
+    for _ in range(ResidueEnd // ResiduePartitionSize):
+        classes = []
+        for ch in range(channels):
+            if used[ch]:
+                classes.append(rnd.randrange(2))
+                w.write_codeword(classes[-1], 1)
+            else:
+                classes.append(None)
+        for ch in range(channels):
+            if classes[ch] == 0:
+                for _ in range(ResiduePartitionSize):
+                    w.write_codeword(rnd.randrange(16), 4)
+    return w.get_bytes()
+
+
+def lacing(packet):
+    return [255] * (len(packet) // 255) + [len(packet) % 255]
+
+
+class Writer:
+    def __init__(self, serial):
+        self.serial = serial
+        self.out = b""
+        self.seq = 0
+
+    def page(self, packets, granule_pos, last=False):
+        segments = sum([lacing(p) for p in packets], [])
+        assert len(segments) <= 255
+        flags = (2 if self.seq == 0 else 0) | (4 if last else 0)
+        header = b"OggS" + bytes([0, flags]) + struct.pack("<qIII", granule_pos, self.serial, self.seq, 0)
+        header += bytes([len(segments)]) + bytes(segments)
+        body = b"".join(packets)
+        crc = ogg_crc(header + body)
+        header = header[:22] + struct.pack("<I", crc) + header[26:]
+        self.out += header + body
+        self.seq += 1
+
+
+def main():
+    assert len(sys.argv) == 3, "usage: %s <channels> <output.ogg>" % sys.argv[0]
+    channels = int(sys.argv[1])
+    rnd = random.Random(channels)
+    writer = Writer(serial=0x0f100f10 + channels)
+    writer.page([id_header(channels)], 0)
+    writer.page([comment_header(), setup_header()], 0)
+
+    num_packets = 40
+    modes = [rnd.randrange(4) for _ in range(num_packets)]
+    blocksizes = [1 << (BlocksizeExp1 if m & 1 else BlocksizeExp0) for m in modes]
+    granule_pos = 0
+    packets = []
+    for i, mode in enumerate(modes):
+        prev_blockflag = modes[i - 1] & 1 if i > 0 else 0
+        next_blockflag = modes[i + 1] & 1 if i + 1 < num_packets else 0
+        packets.append(audio_packet(rnd, channels, mode, prev_blockflag, next_blockflag))
+        if i > 0:
+            granule_pos += blocksizes[i - 1] // 4 + blocksizes[i] // 4
+        # A few packets per page, as an encoder does it.
+        if len(packets) == 4 or i + 1 == num_packets:
+            writer.page(packets, granule_pos, last=i + 1 == num_packets)
+            packets = []
+
+    open(sys.argv[2], "wb").write(writer.out)
+
+
+if __name__ == "__main__":
+    main()
@@ -27,6 +27,7 @@
 #include "scales.h"
 #include "misc.h"
 #include "os.h"
+#include "Callbacks.h"
 
 #include "misc.h"
 #include <stdio.h>
@@ -93,6 +94,7 @@ static vorbis_info_floor *floor0_unpack (vorbis_info *vi,oggpack_buffer *opb){
     if(ci->book_param[info->books[j]]->maptype==0)goto err_out;
     if(ci->book_param[info->books[j]]->dim<1)goto err_out;
   }
+  push_data_int(vi, "floor0_unpack order", -1, &info->order, 1);
   return(info);
 
  err_out:
@@ -184,6 +186,7 @@ static void *floor0_inverse1(vorbis_block *vb,vorbis_look_floor *i){
         for(k=0;j<look->m && k<b->dim;k++,j++)lsp[j]+=last;
         last=lsp[j-1];
       }
+      push_data_float(vb->vd->vi, "floor0 coefficients", -1, lsp, look->m);
 
       lsp[look->m]=amp;
       return(lsp);
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+
+"""
+Rewrites the pages of a single-stream Ogg Vorbis file, such that packets span pages.
+Used to create the test files with continued packets:
+
+    tests/repage-ogg.py tests/audio/test.stereo44khz.ogg tests/audio/test.stereo44khz.spanning.ogg
+
+The id header stays on its own page. The setup header is split over several pages.
+For the audio, the packets stay on their original pages (thus all granule positions stay valid),
+but the first packet of every other page is padded to a few segments
+and starts already on the previous page, or also has a page of its own in the middle.
+(A packet with less than 255 bytes is a single segment, which cannot be split.)
+The padding are zero bytes, and the decoder reads zero bits behind the end of a packet anyway,
+so the decoded PCM stays exactly the same.
+"""
+
+import sys
+import struct
+
+
+def _crc_table():
+    table = []
+    for i in range(256):
+        r = i << 24
+        for _ in range(8):
+            r = ((r << 1) ^ 0x04c11db7) if r & 0x80000000 else (r << 1)
+        table.append(r & 0xffffffff)
+    return table
+
+
+_CrcTable = _crc_table()
+
+
+def ogg_crc(data):
+    crc = 0
+    for x in data:
+        crc = ((crc << 8) & 0xffffffff) ^ _CrcTable[((crc >> 24) & 0xff) ^ x]
+    return crc
+
+
+def read_pages(data):
+    """
+    :return: list of (packets completed on the page, granule pos), serial.
+      We expect that no packet spans pages.
+    """
+    pos = 0
+    pages = []
+    serial = None
+    while pos < len(data):
+        assert data[pos:pos + 4] == b"OggS"
+        granule_pos, page_serial = struct.unpack("<qI", data[pos + 6:pos + 18])
+        assert serial is None or serial == page_serial, "only a single stream is supported"
+        serial = page_serial
+        num_segments = data[pos + 26]
+        segments = data[pos + 27:pos + 27 + num_segments]
+        p = pos + 27 + num_segments
+        packets = []
+        cur = b""
+        for s in segments:
+            cur += data[p:p + s]
+            p += s
+            if s < 255:
+                packets.append(cur)
+                cur = b""
+        assert not cur, "packets spanning pages are not expected in the input"
+        pages.append((packets, granule_pos))
+        pos = p
+    return pages, serial
+
+
+def lacing(packet):
+    return [255] * (len(packet) // 255) + [len(packet) % 255]
+
+
+class Writer:
+    def __init__(self, serial):
+        self.serial = serial
+        self.out = b""
+        self.seq = 0
+        self.continued = False  # whether the next page starts with a continued packet
+
+    def page(self, segments, body, granule_pos, last=False):
+        """
+        :param list[int] segments:
+        :param bytes body:
+        :param int granule_pos: -1 if no packet is completed on this page
+        :param bool last:
+        """
+        flags = (1 if self.continued else 0) | (2 if self.seq == 0 else 0) | (4 if last else 0)
+        header = b"OggS" + bytes([0, flags]) + struct.pack("<qIII", granule_pos, self.serial, self.seq, 0)
+        header += bytes([len(segments)]) + bytes(segments)
+        crc = ogg_crc(header + body)
+        header = header[:22] + struct.pack("<I", crc) + header[26:]
+        self.out += header + body
+        self.seq += 1
+        self.continued = segments[-1] == 255
+
+
+def main():
+    assert len(sys.argv) == 3, "usage: %s <input.ogg> <output.ogg>" % sys.argv[0]
+    pages, serial = read_pages(open(sys.argv[1], "rb").read())
+    assert len(pages[0][0]) == 1 and len(pages[1][0]) == 2, "expected the id header page, and comment + setup page"
+    writer = Writer(serial)
+    writer.page(lacing(pages[0][0][0]), pages[0][0][0], pages[0][1])
+
+    # Comment header and the first 3 segments of the setup header, and then 4 segments per page.
+    comment, setup = pages[1][0]
+    segments = lacing(comment) + lacing(setup)
+    body = comment + setup
+    first = len(lacing(comment)) + 3
+    writer.page(segments[:first], body[:sum(segments[:first])], -1)
+    body = body[sum(segments[:first]):]
+    segments = segments[first:]
+    while segments:
+        n = min(4, len(segments))
+        writer.page(segments[:n], body[:sum(segments[:n])], pages[1][1] if n == len(segments) else -1)
+        body = body[sum(segments[:n]):]
+        segments = segments[n:]
+
+    # Audio pages. prefix: the first segments of the first packet of the next page.
+    audio_pages = pages[2:]
+    prefix = ([], b"")
+    for i, (packets, granule_pos) in enumerate(audio_pages):
+        packets = list(packets)
+        segments, body = list(prefix[0]), prefix[1]
+        packets[0] = packets[0][sum(prefix[0]):] if prefix[0] else packets[0]
+        next_prefix = ([], b"")
+        if i + 1 < len(audio_pages) and i % 2 == 0:
+            next_packets = audio_pages[i + 1][0]
+            pad_len = 1000 if i % 4 == 0 else 600
+            padded = next_packets[0] + b"\0" * max(0, pad_len - len(next_packets[0]))
+            next_packets[0] = padded
+            num = 1 if i % 4 == 0 else 2
+            next_prefix = (lacing(padded)[:num], padded[:255 * num])
+        for packet in packets:
+            segments += lacing(packet)
+            body += packet
+        if next_prefix[0] and i % 4 == 0:
+            # The packet gets a page on its own in the middle, i.e. it spans 3 pages.
+            writer.page(segments + next_prefix[0], body + next_prefix[1], granule_pos)
+            next_prefix = (next_prefix[0] + [255], next_prefix[1] + audio_pages[i + 1][0][0][255:510])
+            writer.page([255], audio_pages[i + 1][0][0][255:510], -1)
+        else:
+            writer.page(segments + next_prefix[0], body + next_prefix[1], granule_pos, last=i + 1 == len(audio_pages))
+        prefix = next_prefix
+
+    open(sys.argv[2], "wb").write(writer.out)
+
+
+if __name__ == "__main__":
+    main()
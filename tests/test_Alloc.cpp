@@ -0,0 +1,96 @@
+//
+//  test_Alloc.cpp
+//  ParseOggVorbis
+//
+//  Checks that the audio packet decode does not do any heap allocations in steady state
+//  (see VorbisStreamDecodeState::scratch).
+//  Build: g++ -std=c++11 -I src tests/test_Alloc.cpp src/ParseOggVorbis.cpp src/Callbacks.cpp src/Utils.cpp src/mdct.cpp src/Simd.cpp -lpthread -o test_Alloc
+//  Run: ./test_Alloc tests/audio/test.stereo44khz.ogg
+//
+
+#include "ParseOggVorbis.hpp"
+#include <stdlib.h>
+#include <new>
+#include <iostream>
+
+using namespace std;
+
+// Test hook: count all heap allocations.
+static size_t alloc_count = 0;
+
+// Not inlined, otherwise GCC sees malloc()/free() paired with operator new/delete (-Wmismatched-new-delete).
+__attribute__((noinline)) void* operator new(size_t size) {
+	++alloc_count;
+	void* ptr = malloc(size ? size : 1);
+	if(!ptr) throw std::bad_alloc();
+	return ptr;
+}
+__attribute__((noinline)) void operator delete(void* ptr) noexcept { free(ptr); }
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+struct CountPcm : ParseCallbacks {
+	size_t num_frames;
+	CountPcm() : num_frames(0) {}
+	virtual bool gotPcmData(const std::vector<DataRange<const float>>& channelPcms) {
+		num_frames += channelPcms[0].size();
+		return true;
+	}
+};
+
+OkOrError checkNoAllocPerPacket(const char* filename) {
+	CountPcm callbacks;
+	OggReader reader(callbacks);
+	// Reads from the file mapping, i.e. also the pages are not copied.
+	CHECK_ERR(reader.open_file(filename));
+	// The headers are allowed to allocate. The scratch arena is reserved with the setup header.
+	bool reached_eof = false;
+	while(!reached_eof && reader.packet_counts_ < 3)
+		CHECK_ERR(reader.read_next_packet(reached_eof));
+	CHECK(!reached_eof);
+	size_t num_packets = 0;
+	while(true) {
+		size_t count_before = alloc_count;
+		size_t packet_counts_before = reader.packet_counts_;
+		CHECK_ERR(reader.read_next_packet(reached_eof));
+		if(reached_eof || reader.streams_.empty())
+			break;
+		size_t num_allocs = alloc_count - count_before;
+		if(num_allocs != 0)
+			cerr << "packet " << packet_counts_before << ": " << num_allocs << " allocations" << endl;
+		CHECK(num_allocs == 0);
+		CHECK(reader.streams_.begin()->second.decode_state.scratch.num_overflows_ == 0);
+		++num_packets;
+	}
+	CHECK(num_packets > 0);
+	CHECK(callbacks.num_frames > 0);
+	cout << filename << ": " << num_packets << " packets without allocation" << endl;
+	return OkOrError();
+}
+
+OkOrError checkScratchArena() {
+	ScratchArena scratch;
+	scratch.reserve(100);
+	DataRange<float> a = scratch.alloc<float>(10);
+	CHECK(uintptr_t(a.begin()) % ScratchArena::Alignment == 0);
+	DataRange<uint8_t> b = scratch.alloc<uint8_t>(1);
+	CHECK(uintptr_t(b.begin()) % ScratchArena::Alignment == 0);
+	CHECK(b.begin() >= (uint8_t*) a.end());
+	CHECK(scratch.num_overflows_ == 0);
+	DataRange<float> c = scratch.alloc<float>(100); // too much
+	CHECK(c.size() == 100);
+	CHECK(scratch.num_overflows_ == 1);
+	scratch.reset();
+	CHECK(scratch.capacity() >= 3 * ScratchArena::Alignment + 100 * sizeof(float));
+	scratch.alloc<float>(10);
+	scratch.alloc<uint8_t>(1);
+	scratch.alloc<float>(100);
+	CHECK(scratch.num_overflows_ == 1);
+	return OkOrError();
+}
+
+int main(int argc, char** argv) {
+	ASSERT_ERR(checkScratchArena());
+	for(int i = 1; i < argc; ++i)
+		ASSERT_ERR(checkNoAllocPerPacket(argv[i]));
+	return 0;
+}
@@ -0,0 +1,142 @@
+//
+//  test_Codebook.cpp
+//  ParseOggVorbis
+//
+//  Checks the table-driven Huffman decoding (VorbisCodebook::decodeScalar_table)
+//  against the direct decoding from the spec (decodeScalar_slow), for various codebook shapes.
+//  Build: g++ -std=c++11 -I src tests/test_Codebook.cpp src/ParseOggVorbis.cpp src/Callbacks.cpp src/Utils.cpp src/mdct.cpp src/Simd.cpp -lpthread -o test_Codebook
+//  Run: ./test_Codebook
+//
+
+#include "ParseOggVorbis.hpp"
+#include <iostream>
+
+using namespace std;
+
+// Deterministic pseudo random numbers.
+static uint32_t randInt(uint32_t& state, uint32_t n) {
+	state = state * 1103515245 + 12345;
+	return (state >> 8) % n;
+}
+
+// Writes the bits in the order in which PacketBitReader reads them (LSb first).
+struct BitWriter {
+	vector<uint8_t> data;
+	size_t bit_pos;
+	BitWriter() : bit_pos(0) {}
+	void writeBit(bool bit) {
+		if(bit_pos % 8 == 0)
+			data.push_back(0);
+		if(bit)
+			data.back() |= uint8_t(1) << (bit_pos % 8);
+		++bit_pos;
+	}
+	// The codeword is read MSb first (spec 3.2.1).
+	void writeCodeword(uint32_t codeword, uint8_t len) {
+		for(uint8_t i = len; i > 0; --i)
+			writeBit((codeword >> (i - 1)) & 1);
+	}
+};
+
+// lens: codeword length per used entry. nums: entry number per used entry (sparse if not contiguous).
+OkOrError checkCodebook(const char* name, const vector<uint8_t>& lens, const vector<uint32_t>& nums, uint32_t num_entries) {
+	VorbisCodebook book;
+	book.num_entries_ = num_entries;
+	book.entries_.resize(lens.size());
+	for(size_t i = 0; i < lens.size(); ++i)
+		book.entries_[i].init(nums[i], lens[i]);
+	CHECK_ERR(book._assignCodewords());
+
+	// Every entry, and then random entries.
+	BitWriter writer;
+	vector<uint32_t> expected;
+	uint32_t state = uint32_t(lens.size());
+	for(size_t i = 0; i < book.entries_.size() + 1000; ++i) {
+		const VorbisCodebook::Entry& entry = book.entries_[i < book.entries_.size() ? i : randInt(state, uint32_t(book.entries_.size()))];
+		writer.writeCodeword(entry.codeword_, entry.len_);
+		expected.push_back(entry.num_);
+	}
+	PacketBitReader table_reader(writer.data.data(), writer.data.size());
+	PacketBitReader slow_reader(writer.data.data(), writer.data.size());
+	for(uint32_t num : expected) {
+		CHECK(book.decodeScalar_table(table_reader) == num);
+		CHECK(book.decodeScalar_slow(slow_reader) == num);
+		CHECK(table_reader.bitPos() == slow_reader.bitPos());
+	}
+	CHECK(table_reader.bitPos() == writer.bit_pos);
+	uint8_t max_len = 0;
+	for(uint8_t len : lens)
+		max_len = std::max(max_len, len);
+	cout << name << ": " << lens.size() << " entries, max len " << int(max_len)
+		<< ", table size " << book.decode_table_.size() << " ok" << endl;
+	return OkOrError();
+}
+
+// Random complete (Kraft sum 1) code with num_leafs codewords of length <= max_len.
+static vector<uint8_t> randomCodeLens(uint32_t& state, size_t num_leafs, uint8_t max_len) {
+	vector<uint8_t> lens = {1, 1};
+	while(lens.size() < num_leafs) {
+		size_t i = randInt(state, uint32_t(lens.size()));
+		if(lens[i] >= max_len)
+			continue;
+		++lens[i];
+		lens.insert(lens.begin() + i + 1, lens[i]);
+	}
+	// Shuffle, the codeword assignment depends on the entry order.
+	for(size_t i = lens.size() - 1; i > 0; --i)
+		std::swap(lens[i], lens[randInt(state, uint32_t(i + 1))]);
+	return lens;
+}
+
+static vector<uint32_t> range(size_t n, uint32_t step = 1, uint32_t offset = 0) {
+	vector<uint32_t> nums(n);
+	for(size_t i = 0; i < n; ++i)
+		nums[i] = offset + uint32_t(i) * step;
+	return nums;
+}
+
+OkOrError checkCodebooks() {
+	// Balanced: all codewords of the same length, exactly the table width, and one more.
+	CHECK_ERR(checkCodebook("balanced 3", vector<uint8_t>(8, 3), range(8), 8));
+	CHECK_ERR(checkCodebook("balanced 10", vector<uint8_t>(1024, 10), range(1024), 1024));
+	CHECK_ERR(checkCodebook("balanced 11", vector<uint8_t>(2048, 11), range(2048), 2048));
+	// Maximally skewed: lengths 1, 2, ..., 30, 31, 31. Several levels of subtables.
+	{
+		vector<uint8_t> lens;
+		for(uint8_t len = 1; len <= 31; ++len)
+			lens.push_back(len);
+		lens.push_back(31);
+		CHECK_ERR(checkCodebook("skewed", lens, range(lens.size()), uint32_t(lens.size())));
+		// Same, but in reverse order, i.e. the long codewords get assigned first.
+		std::reverse(lens.begin(), lens.end());
+		CHECK_ERR(checkCodebook("skewed reversed", lens, range(lens.size()), uint32_t(lens.size())));
+	}
+	// Ordered (spec 3.2.1: lengths non-decreasing), as produced by the encoder for the residue books.
+	{
+		uint32_t state = 1;
+		vector<uint8_t> lens = randomCodeLens(state, 300, 17);
+		std::sort(lens.begin(), lens.end());
+		CHECK_ERR(checkCodebook("ordered", lens, range(lens.size()), uint32_t(lens.size())));
+	}
+	// Sparse: only every third entry is used.
+	{
+		uint32_t state = 2;
+		vector<uint8_t> lens = randomCodeLens(state, 100, 14);
+		CHECK_ERR(checkCodebook("sparse", lens, range(lens.size(), 3, 1), uint32_t(lens.size() * 3)));
+	}
+	// Random shapes, with codewords around and far beyond the table width.
+	for(uint32_t i = 0; i < 20; ++i) {
+		uint32_t state = 100 + i;
+		uint8_t max_len = uint8_t(4 + i * 27 / 19); // up to 31
+		size_t num = std::min(size_t(2) + randInt(state, 2000), size_t(1) << max_len);
+		vector<uint8_t> lens = randomCodeLens(state, num, max_len);
+		string name = "random " + to_string(i);
+		CHECK_ERR(checkCodebook(name.c_str(), lens, range(lens.size()), uint32_t(lens.size())));
+	}
+	return OkOrError();
+}
+
+int main() {
+	ASSERT_ERR(checkCodebooks());
+	return 0;
+}
@@ -0,0 +1,659 @@
+//
+//  test_Decode.cpp
+//  ParseOggVorbis
+//
+//  Regression tests for the decoding entry points besides a plain full read.
+//  All of them must give exactly the same PCM as a full decode (OggReader::full_read_from_memory).
+//  Build: g++ -std=c++11 -I src tests/test_Decode.cpp src/ParseOggVorbis.cpp src/Callbacks.cpp src/Utils.cpp src/mdct.cpp src/Simd.cpp -lpthread -o test_Decode
+//  Run: ./test_Decode tests/audio/test.mono44khz.ogg tests/audio/test.stereo44khz.ogg tests/audio/test.floor0.mono.ogg tests/audio/test.floor0.4ch.ogg --same-pcm-as tests/audio/test.stereo44khz.ogg tests/audio/test.stereo44khz.spanning.ogg
+//
+
+#include "ParseOggVorbis.hpp"
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <thread>
+#include <cstdio>
+
+using namespace std;
+
+struct CollectPcm : ParseCallbacks {
+	vector<vector<float>> pcm; // per channel
+	virtual bool gotPcmData(const std::vector<DataRange<const float>>& channelPcms) {
+		pcm.resize(channelPcms.size());
+		for(size_t c = 0; c < channelPcms.size(); ++c)
+			pcm[c].insert(pcm[c].end(), channelPcms[c].begin(), channelPcms[c].end());
+		return true;
+	}
+	size_t num_frames() const { return pcm.empty() ? 0 : pcm[0].size(); }
+};
+
+// Checks that got is exactly ref[start, end) (clipped to the ref length), for all channels.
+OkOrError checkSamePcm(const CollectPcm& ref, const CollectPcm& got, uint64_t start, uint64_t end) {
+	size_t n = ref.num_frames();
+	size_t lo = size_t(std::min(start, uint64_t(n))), hi = size_t(std::min(end, uint64_t(n)));
+	CHECK(got.num_frames() == hi - lo);
+	if(hi == lo)
+		return OkOrError();
+	CHECK(got.pcm.size() == ref.pcm.size());
+	for(size_t c = 0; c < ref.pcm.size(); ++c)
+		CHECK(std::equal(got.pcm[c].begin(), got.pcm[c].end(), ref.pcm[c].begin() + lo));
+	return OkOrError();
+}
+
+struct TestFile {
+	string filename;
+	vector<uint8_t> data;
+	CollectPcm ref; // full decode
+
+	OkOrError load(const string& fn) {
+		filename = fn;
+		ifstream f(fn, ios::binary);
+		CHECK(f.good());
+		data.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+		CHECK(!data.empty());
+		OggReader reader(ref);
+		CHECK_ERR(reader.full_read_from_memory(data.data(), data.size()));
+		CHECK(ref.num_frames() > 0);
+		return OkOrError();
+	}
+
+	shared_ptr<IReader> new_reader() const {
+		return make_shared<ConstDataReader>(data.data(), data.size());
+	}
+
+	// About 40 positions: the start, the packet boundaries of the first blocks, the end, and in between.
+	vector<uint64_t> seek_positions() const {
+		uint64_t n = ref.num_frames();
+		vector<uint64_t> positions = {0, 1, 63, 64, 127, 128, 255, 256, 1023, 1024, 2047, 2048};
+		for(uint64_t i = 1; i < 25; ++i)
+			positions.push_back(n * i / 25 + i);
+		for(uint64_t pos : {n - 1, n, n + 10})
+			positions.push_back(pos);
+		return positions;
+	}
+};
+
+OkOrError checkSeek(const TestFile& file) {
+	uint64_t n = file.ref.num_frames();
+	for(uint64_t pos : file.seek_positions()) {
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		CHECK_ERR(reader.set_reader(file.new_reader()));
+		CHECK_ERR(reader.seek_to_sample(pos));
+		CHECK_ERR(reader.read_until_end());
+		OkOrError check_res = checkSamePcm(file.ref, callbacks, pos, n);
+		if(check_res.is_error_)
+			cerr << file.filename << ": seek to " << pos << " failed" << endl;
+		CHECK_ERR(check_res);
+	}
+	// The test files are smaller than the default seek chunk, i.e. seek_to_sample() would just scan them linearly.
+	// With small chunks, the bisection is used, and the page search crosses chunk boundaries.
+	for(uint32_t chunk_size : {256, 4096}) {
+		for(uint64_t pos : file.seek_positions()) {
+			CollectPcm callbacks;
+			OggReader reader(callbacks);
+			reader.set_seek_chunk_size(chunk_size);
+			CHECK_ERR(reader.set_reader(file.new_reader()));
+			CHECK_ERR(reader.seek_to_sample(pos));
+			CHECK_ERR(reader.read_until_end());
+			OkOrError check_res = checkSamePcm(file.ref, callbacks, pos, n);
+			if(check_res.is_error_)
+				cerr << file.filename << ": seek to " << pos << " with chunk size " << chunk_size << " failed" << endl;
+			CHECK_ERR(check_res);
+		}
+		ParseCallbacks callbacks;
+		OggReader reader(callbacks), ref_reader(callbacks);
+		reader.set_seek_chunk_size(chunk_size);
+		OggReader::ProbeInfo info, ref_info;
+		CHECK_ERR(reader.probe_from_memory(file.data.data(), file.data.size(), info));
+		CHECK_ERR(ref_reader.probe_from_memory(file.data.data(), file.data.size(), ref_info));
+		CHECK(info.end_granule_pos == ref_info.end_granule_pos);
+	}
+	// Seek twice with the same reader, after some decoding (also before the first seek, within a page).
+	CollectPcm callbacks;
+	OggReader reader(callbacks);
+	CHECK_ERR(reader.set_reader(file.new_reader()));
+	bool reached_eof = false;
+	for(int i = 0; i < 5 && !reached_eof; ++i)
+		CHECK_ERR(reader.read_next_packet(reached_eof));
+	CHECK_ERR(reader.seek_to_sample(n / 2));
+	for(int i = 0; i < 3 && !reached_eof; ++i)
+		CHECK_ERR(reader.read_next_page(reached_eof));
+	callbacks.pcm.clear();
+	CHECK_ERR(reader.seek_to_sample(n / 3));
+	CHECK_ERR(reader.read_until_end());
+	CHECK_ERR(checkSamePcm(file.ref, callbacks, n / 3, n));
+	cout << file.filename << ": seek ok" << endl;
+	return OkOrError();
+}
+
+struct CountSeeksReader : ConstDataReader {
+	size_t num_seeks;
+	CountSeeksReader(const uint8_t* data, size_t data_len) : ConstDataReader(data, data_len), num_seeks(0) {}
+	virtual OkOrError seek(uint64_t pos) override {
+		++num_seeks;
+		return ConstDataReader::seek(pos);
+	}
+};
+
+OkOrError checkSeekIndex(const TestFile& file) {
+	uint64_t n = file.ref.num_frames();
+	OggSeekIndex index;
+	{
+		ParseCallbacks callbacks;
+		OggReader reader(callbacks);
+		CHECK_ERR(reader.set_reader(file.new_reader()));
+		CHECK_ERR(reader.build_seek_index(index));
+	}
+	CHECK(index.file_size == file.data.size());
+	CHECK(!index.entries.empty());
+	// Serialization roundtrip. save/load is the same via a file.
+	vector<uint8_t> blob = index.serialize();
+	OggSeekIndex loaded;
+	CHECK_ERR(loaded.deserialize(blob.data(), blob.size()));
+	CHECK(loaded.serialize() == blob);
+	blob[blob.size() / 2] ^= 1;
+	OggSeekIndex corrupted;
+	CHECK(corrupted.deserialize(blob.data(), blob.size()).is_error_);
+
+	for(uint64_t pos : file.seek_positions()) {
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		shared_ptr<CountSeeksReader> counting_reader = make_shared<CountSeeksReader>(file.data.data(), file.data.size());
+		CHECK_ERR(reader.set_reader(counting_reader));
+		CHECK_ERR(reader.seek_to_sample(0, loaded)); // reads the headers
+		callbacks.pcm.clear();
+		size_t num_seeks_before = counting_reader->num_seeks;
+		CHECK_ERR(reader.seek_to_sample(pos, loaded));
+		if(loaded.find(pos))
+			CHECK(counting_reader->num_seeks == num_seeks_before + 1); // no bisection
+		CHECK_ERR(reader.read_until_end());
+		OkOrError check_res = checkSamePcm(file.ref, callbacks, pos, n);
+		if(check_res.is_error_)
+			cerr << file.filename << ": index seek to " << pos << " failed" << endl;
+		CHECK_ERR(check_res);
+	}
+
+	// A stale index (here: wrong file size) must be detected.
+	{
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		CHECK_ERR(reader.set_reader(make_shared<ConstDataReader>(file.data.data(), file.data.size() - 1)));
+		CHECK(reader.seek_to_sample(n / 2, loaded).is_error_);
+	}
+	cout << file.filename << ": seek index ok (" << index.entries.size() << " entries)" << endl;
+	return OkOrError();
+}
+
+// Without seeking, read_sample_range has to skip the packets before the range.
+struct NonSeekableReader : ConstDataReader {
+	NonSeekableReader(const uint8_t* data, size_t data_len) : ConstDataReader(data, data_len) {}
+	virtual bool isSeekable() override { return false; }
+};
+
+OkOrError checkSampleRange(const TestFile& file) {
+	uint64_t n = file.ref.num_frames();
+	for(bool seekable : {true, false})
+	for(uint64_t start : file.seek_positions())
+	for(uint64_t len : {0, 1, 100, 5000, 40000}) {
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		if(seekable)
+			CHECK_ERR(reader.set_reader(file.new_reader()));
+		else
+			CHECK_ERR(reader.set_reader(make_shared<NonSeekableReader>(file.data.data(), file.data.size())));
+		CHECK_ERR(reader.read_sample_range(start, start + len));
+		OkOrError check_res = checkSamePcm(file.ref, callbacks, start, start + len);
+		if(check_res.is_error_)
+			cerr << file.filename << ": sample range [" << start << ", " << start + len << ") failed, seekable " << seekable << endl;
+		CHECK_ERR(check_res);
+	}
+	// set_sample_range with a full read, and a range which stops before the end.
+	{
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		reader.set_sample_range(n / 4, n / 2);
+		CHECK_ERR(reader.full_read_from_memory(file.data.data(), file.data.size()));
+		CHECK_ERR(checkSamePcm(file.ref, callbacks, n / 4, n / 2));
+		CHECK(reader.range_done_);
+	}
+	cout << file.filename << ": sample range ok" << endl;
+	return OkOrError();
+}
+
+// Reads everything via OggVorbisDecoder::read with the given chunk size, appending to out.
+OkOrError pullAll(OggVorbisDecoder& decoder, size_t chunk_size, CollectPcm& out) {
+	size_t num_channels = decoder.channels();
+	vector<vector<float>> buffers(num_channels, vector<float>(chunk_size));
+	vector<float*> ptrs(num_channels);
+	for(size_t c = 0; c < num_channels; ++c)
+		ptrs[c] = buffers[c].data();
+	out.pcm.resize(num_channels);
+	while(true) {
+		size_t num_frames = 0;
+		CHECK_ERR(decoder.read(ptrs.data(), chunk_size, num_frames));
+		CHECK(num_frames <= chunk_size);
+		for(size_t c = 0; c < num_channels; ++c)
+			out.pcm[c].insert(out.pcm[c].end(), buffers[c].begin(), buffers[c].begin() + num_frames);
+		if(num_frames < chunk_size)
+			break;
+	}
+	return OkOrError();
+}
+
+OkOrError checkPull(const TestFile& file) {
+	uint64_t n = file.ref.num_frames();
+	for(size_t chunk_size : {1, 2, 7, 64, 255, 256, 1000, 1024, 2048, 4096, 5000}) {
+		OggVorbisDecoder decoder;
+		CHECK_ERR(decoder.open_memory(file.data.data(), file.data.size()));
+		CHECK_ERR(decoder.read_headers());
+		CHECK(decoder.channels() == file.ref.pcm.size());
+		size_t capacity = decoder.pending_[0].capacity();
+		CollectPcm callbacks;
+		CHECK_ERR(pullAll(decoder, chunk_size, callbacks));
+		CHECK(decoder.pending_[0].capacity() == capacity); // no reallocation
+		OkOrError check_res = checkSamePcm(file.ref, callbacks, 0, n);
+		if(check_res.is_error_)
+			cerr << file.filename << ": read with chunk size " << chunk_size << " failed" << endl;
+		CHECK_ERR(check_res);
+	}
+	// Seek, then read, also after some reads before.
+	for(uint64_t pos : {n / 3, n / 7, n - 1}) {
+		OggVorbisDecoder decoder;
+		CHECK_ERR(decoder.open_memory(file.data.data(), file.data.size()));
+		CHECK_ERR(decoder.read_headers());
+		float buffer[333];
+		vector<float*> ptrs(decoder.channels(), buffer); // all channels into the same buffer, we ignore it
+		size_t num_frames = 0;
+		CHECK_ERR(decoder.read(ptrs.data(), 333, num_frames));
+		CHECK(num_frames == 333);
+		CHECK_ERR(decoder.seek_to_sample(pos));
+		CollectPcm callbacks;
+		CHECK_ERR(pullAll(decoder, 333, callbacks));
+		CHECK_ERR(checkSamePcm(file.ref, callbacks, pos, n));
+	}
+	cout << file.filename << ": pull read ok" << endl;
+	return OkOrError();
+}
+
+OkOrError checkFeed(const TestFile& file) {
+	uint64_t n = file.ref.num_frames();
+	for(CrcCheck crc_check : {CrcCheck_Verify, CrcCheck_VerifyLazily, CrcCheck_Skip})
+	for(size_t chunk_size : {1, 2, 27, 28, 100, 255, 256, 1000, 4096, 0}) { // 0: pseudo random sizes
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		reader.set_crc_check(crc_check);
+		uint32_t rnd = uint32_t(crc_check) + 1;
+		size_t pos = 0;
+		while(pos < file.data.size()) {
+			size_t len = chunk_size;
+			if(len == 0) {
+				rnd = rnd * 1103515245 + 12345;
+				len = (rnd >> 16) % 300;
+			}
+			len = std::min(len, file.data.size() - pos);
+			CHECK_ERR(reader.feed(file.data.data() + pos, len));
+			pos += len;
+		}
+		CHECK_ERR(reader.feed_end());
+		OkOrError check_res = checkSamePcm(file.ref, callbacks, 0, n);
+		if(check_res.is_error_)
+			cerr << file.filename << ": feed with chunk size " << chunk_size << " and CRC check " << crc_check << " failed" << endl;
+		CHECK_ERR(check_res);
+	}
+	// Truncated input.
+	{
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		CHECK_ERR(reader.feed(file.data.data(), file.data.size() - 5));
+		CHECK(reader.feed_end().is_error_);
+	}
+	// A corrupted page is detected, with all policies except CrcCheck_Skip.
+	vector<uint8_t> corrupted = file.data;
+	corrupted[corrupted.size() - 100] ^= 1;
+	for(CrcCheck crc_check : {CrcCheck_Verify, CrcCheck_VerifyLazily}) {
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		reader.set_crc_check(crc_check);
+		CHECK(reader.feed(corrupted.data(), corrupted.size()).is_error_);
+	}
+	cout << file.filename << ": feed ok" << endl;
+	return OkOrError();
+}
+
+// The byte offsets of all pages.
+static vector<size_t> pageOffsets(const vector<uint8_t>& data) {
+	vector<size_t> offsets;
+	for(size_t pos = 0; pos + 27 <= data.size();) {
+		offsets.push_back(pos);
+		size_t num_segments = data[pos + 26];
+		size_t offset = pos + 27 + num_segments;
+		for(size_t i = 0; i < num_segments; ++i)
+			offset += data[pos + 27 + i];
+		pos = offset;
+	}
+	return offsets;
+}
+
+// The probe gives the number of samples, also when the stream does not start at 0, like a cut live capture.
+OkOrError checkProbe(const TestFile& file) {
+	int64_t n = int64_t(file.ref.num_frames());
+	// A negative shift means samples to trim at the start (like the encoder does it at the end), then it starts at 0.
+	for(int64_t shift : {0, 1, 12345, 1 << 30, -100}) {
+		int64_t start = std::max(shift, int64_t(0));
+		// Add shift to the granule pos of all audio pages, and fix their CRC.
+		vector<uint8_t> data = file.data;
+		for(size_t offset : pageOffsets(data)) {
+			PageHeader header;
+			memcpy(&header, &data[offset], sizeof(PageHeader));
+			if(header.absolute_granule_pos <= 0) // the header pages, or no packet completed
+				continue;
+			header.absolute_granule_pos += shift;
+			const uint8_t* segment_table = &data[offset + sizeof(PageHeader)];
+			uint32_t data_len = 0;
+			for(uint8_t i = 0; i < header.page_segments_num; ++i)
+				data_len += segment_table[i];
+			header.page_crc_checksum = Page::calc_crc(header, segment_table, segment_table + header.page_segments_num, data_len);
+			memcpy(&data[offset], &header, sizeof(PageHeader));
+		}
+		ParseCallbacks callbacks;
+		OggReader reader(callbacks);
+		OggReader::ProbeInfo info;
+		CHECK_ERR(reader.probe_from_memory(data.data(), data.size(), info));
+		if(info.start_granule_pos != start || info.end_granule_pos != n + shift)
+			cerr << file.filename << ": probe with shift " << shift << ": start " << info.start_granule_pos << ", end " << info.end_granule_pos << endl;
+		CHECK(info.start_granule_pos == start);
+		CHECK(info.end_granule_pos == n + shift);
+		OggVorbisProbeInfo c_info;
+		const char* err = nullptr;
+		CHECK(ogg_vorbis_probe_from_memory((const char*) data.data(), data.size(), &c_info, &err) == 0);
+		CHECK(c_info.num_samples == info.num_samples());
+		if(shift <= 0) { // the decoder only supports streams which start at 0
+			CollectPcm pcm;
+			OggReader decoder(pcm);
+			CHECK_ERR(decoder.full_read_from_memory(data.data(), data.size()));
+			CHECK(int64_t(pcm.num_frames()) == info.num_samples());
+		}
+		else
+			CHECK(info.num_samples() == n);
+	}
+	cout << file.filename << ": probe ok" << endl;
+	return OkOrError();
+}
+
+// CrcCheck_VerifyLazily with the shared background verifier, via IReader::view (mmap, memory).
+OkOrError checkLazyCrc(const TestFile& file) {
+	// Several readers at once, all with the same worker thread.
+	{
+		vector<OkOrError> results(4);
+		vector<thread> threads;
+		for(size_t i = 0; i < results.size(); ++i)
+			threads.emplace_back([&file, &results, i]() {
+				CollectPcm callbacks;
+				OggReader reader(callbacks);
+				reader.set_crc_check(CrcCheck_VerifyLazily);
+				results[i] = reader.full_read(file.filename);
+				if(!results[i].is_error_)
+					results[i] = checkSamePcm(file.ref, callbacks, 0, file.ref.num_frames());
+			});
+		for(thread& t : threads)
+			t.join();
+		for(const OkOrError& thread_res : results)
+			CHECK_ERR(thread_res);
+	}
+	// Corrupt only the CRC field of a page in the middle, such that the decoding itself still works,
+	// and only the verifier can find it.
+	vector<size_t> page_offsets = pageOffsets(file.data);
+	CHECK(page_offsets.size() >= 4);
+	vector<uint8_t> corrupted = file.data;
+	corrupted[page_offsets[page_offsets.size() / 2] + 22] ^= 1;
+	const string corrupted_filename = "test_Decode.corrupted.ogg";
+	{
+		ofstream f(corrupted_filename, ios::binary);
+		f.write((const char*) corrupted.data(), corrupted.size());
+		CHECK(f.good());
+	}
+	for(CrcCheck crc_check : {CrcCheck_Verify, CrcCheck_VerifyLazily, CrcCheck_Skip})
+	for(bool use_mmap : {true, false}) {
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		reader.set_crc_check(crc_check);
+		OkOrError read_res = use_mmap ? reader.full_read(corrupted_filename) : reader.full_read_from_memory(corrupted.data(), corrupted.size());
+		if(crc_check == CrcCheck_Skip) {
+			CHECK_ERR(read_res);
+			CHECK_ERR(checkSamePcm(file.ref, callbacks, 0, file.ref.num_frames()));
+		}
+		else {
+			CHECK(read_res.is_error_);
+			if(crc_check == CrcCheck_VerifyLazily) // found by the verifier, not by the decoding
+				CHECK(read_res.err_msg_.find("CRC mismatch") != string::npos);
+		}
+	}
+	std::remove(corrupted_filename.c_str());
+	cout << file.filename << ": lazy CRC ok" << endl;
+	return OkOrError();
+}
+
+// Byte offsets (in the file) of the ends of the packets which end within a page, i.e. not at the end of the page.
+// Only for the audio packets, except the first (which does not return any PCM). Single stream only.
+static vector<size_t> audioPacketEndsWithinPages(const vector<uint8_t>& data) {
+	vector<size_t> ends;
+	size_t pos = 0, packet_count = 0;
+	while(pos + 27 <= data.size()) {
+		size_t num_segments = data[pos + 26];
+		size_t offset = pos + 27 + num_segments;
+		for(size_t i = 0; i < num_segments; ++i) {
+			uint8_t segment = data[pos + 27 + i];
+			offset += segment;
+			if(segment < 255) {
+				if(packet_count >= 4 && i + 1 < num_segments)
+					ends.push_back(offset);
+				++packet_count;
+			}
+		}
+		pos = offset;
+	}
+	return ends;
+}
+
+// Byte by byte, each audio packet must be decoded as soon as its last byte is there, before the rest of its page.
+// Except with CrcCheck_Verify, which needs the complete page first.
+OkOrError checkFeedLatency(const TestFile& file) {
+	vector<size_t> packet_ends = audioPacketEndsWithinPages(file.data);
+	CHECK(!packet_ends.empty());
+	for(CrcCheck crc_check : {CrcCheck_Verify, CrcCheck_VerifyLazily, CrcCheck_Skip}) {
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		reader.set_crc_check(crc_check);
+		size_t next_end = 0, num_frames = 0;
+		for(size_t pos = 0; pos < file.data.size(); ++pos) {
+			CHECK_ERR(reader.feed(&file.data[pos], 1));
+			if(next_end < packet_ends.size() && pos + 1 == packet_ends[next_end]) {
+				if(crc_check == CrcCheck_Verify)
+					CHECK(callbacks.num_frames() == num_frames);
+				else {
+					if(callbacks.num_frames() <= num_frames)
+						cerr << file.filename << ": no PCM after the packet ending at " << pos + 1 << " with CRC check " << crc_check << endl;
+					CHECK(callbacks.num_frames() > num_frames);
+				}
+				++next_end;
+			}
+			num_frames = callbacks.num_frames();
+		}
+		CHECK(next_end == packet_ends.size());
+		CHECK_ERR(reader.feed_end());
+		CHECK_ERR(checkSamePcm(file.ref, callbacks, 0, file.ref.num_frames()));
+	}
+	cout << file.filename << ": feed latency ok (" << packet_ends.size() << " packets within pages)" << endl;
+	return OkOrError();
+}
+
+// The interleaved output (ogg_vorbis_decode_interleaved_from_memory, InterleavedPcmSink) against the planar PCM.
+OkOrError checkInterleaved(const TestFile& file) {
+	size_t n = file.ref.num_frames(), channels = file.ref.pcm.size();
+	// The expected int values, per channel, without dither.
+	vector<vector<int16_t>> ref16(channels, vector<int16_t>(n));
+	vector<vector<int32_t>> ref24(channels, vector<int32_t>(n));
+	for(size_t c = 0; c < channels; ++c) {
+		simd_float_to_int16_scalar(ref16[c].data(), 1, file.ref.pcm[c].data(), n, nullptr);
+		simd_float_to_int24_scalar(ref24[c].data(), 1, file.ref.pcm[c].data(), n, nullptr);
+	}
+	for(PcmFormat format : {PcmFormat_Float32, PcmFormat_Int16, PcmFormat_Int24})
+	for(bool dither : {false, true})
+	for(size_t max_frames : {n, n + 10, n - 1}) { // n - 1: the buffer is too small
+		size_t sample_size = InterleavedPcmSink::sampleSize(format);
+		vector<uint8_t> out(max_frames * channels * sample_size);
+		size_t num_frames = 0;
+		const char* err = nullptr;
+		int ret = ogg_vorbis_decode_interleaved_from_memory(
+			(const char*) file.data.data(), file.data.size(), format, dither, out.data(), max_frames, &num_frames, &err);
+		if(max_frames < n) {
+			CHECK(ret != 0);
+			CHECK(err && string(err).find("too small") != string::npos);
+			CHECK(num_frames == max_frames);
+		}
+		else {
+			if(ret != 0)
+				cerr << file.filename << ": interleaved decode failed: " << err << endl;
+			CHECK(ret == 0);
+			CHECK(num_frames == n);
+		}
+		// Whatever was written must be correct.
+		for(size_t i = 0; i < num_frames; ++i)
+		for(size_t c = 0; c < channels; ++c) {
+			size_t offset = i * channels + c;
+			if(format == PcmFormat_Float32)
+				CHECK(((const float*) out.data())[offset] == file.ref.pcm[c][i]);
+			else if(format == PcmFormat_Int16) {
+				int v = ((const int16_t*) out.data())[offset];
+				CHECK(dither ? abs(v - ref16[c][i]) <= 1 : v == ref16[c][i]);
+			}
+			else {
+				// The dithered value is rounded to float first, which has only a resolution of 0.5 above 2^22.
+				int32_t v = ((const int32_t*) out.data())[offset];
+				CHECK(dither ? abs(v - ref24[c][i]) <= 2 : v == ref24[c][i]);
+			}
+		}
+	}
+	// A small buffer which is consumed with bufferFull().
+	struct ChunkedSink : InterleavedPcmSink {
+		vector<int16_t> chunk, all;
+		ChunkedSink() : InterleavedPcmSink(PcmFormat_Int16, nullptr, 100) {}
+		virtual bool gotHeader(const VorbisIdHeader& header) {
+			chunk.resize(buffer_frames * header.audio_channels);
+			buffer = (uint8_t*) chunk.data();
+			return InterleavedPcmSink::gotHeader(header);
+		}
+		virtual bool bufferFull() {
+			all.insert(all.end(), chunk.begin(), chunk.begin() + num_frames * num_channels);
+			clear();
+			return true;
+		}
+	};
+	ChunkedSink sink;
+	OggReader reader(sink);
+	CHECK_ERR(reader.full_read_from_memory(file.data.data(), file.data.size()));
+	sink.bufferFull();
+	CHECK(sink.all.size() == n * channels);
+	for(size_t i = 0; i < n; ++i)
+		for(size_t c = 0; c < channels; ++c)
+			CHECK(sink.all[i * channels + c] == ref16[c][i]);
+	cout << file.filename << ": interleaved ok" << endl;
+	return OkOrError();
+}
+
+// Reads the headers, and returns the decoder context of the (first) stream.
+OkOrError readContext(const vector<uint8_t>& data, shared_ptr<const VorbisDecoderContext>& context) {
+	ParseCallbacks callbacks;
+	OggReader reader(callbacks);
+	CHECK_ERR(reader.set_reader(make_shared<ConstDataReader>(data.data(), data.size())));
+	bool reached_eof = false;
+	while(!reached_eof && reader.packet_counts_ < 3)
+		CHECK_ERR(reader.read_next_packet(reached_eof));
+	CHECK(!reader.streams_.empty() && reader.streams_.begin()->second.context);
+	context = reader.streams_.begin()->second.context;
+	return OkOrError();
+}
+
+OkOrError checkContextCache(const TestFile& file) {
+	// Same file, but another nominal bitrate in the id header, i.e. the setup is the same.
+	vector<uint8_t> data = file.data;
+	CHECK(data.size() > 27 && data[26] == 1); // first page: only the id header packet
+	size_t page_len = 27 + 1 + data[27];
+	CHECK(page_len <= data.size());
+	uint8_t* id_header = &data[28];
+	CHECK(id_header[0] == 1 && memcmp(id_header + 1, "vorbis", 6) == 0);
+	id_header[7 + 4 + 1 + 4 + 4] ^= 1; // bitrate_nominal, after version, channels, sample rate, bitrate_maximum
+	memset(&data[22], 0, 4); // page CRC
+	uint32_t crc = update_crc(0, data.data(), int(page_len));
+	for(int i = 0; i < 4; ++i)
+		data[22 + i] = uint8_t(crc >> (i * 8));
+
+	shared_ptr<const VorbisDecoderContext> context1, context2;
+	CHECK_ERR(readContext(file.data, context1));
+	CHECK_ERR(readContext(data, context2));
+	CHECK(context1 == context2);
+	CollectPcm callbacks;
+	OggReader reader(callbacks);
+	CHECK_ERR(reader.full_read_from_memory(data.data(), data.size()));
+	CHECK_ERR(checkSamePcm(file.ref, callbacks, 0, file.ref.num_frames()));
+	cout << file.filename << ": context cache ok" << endl;
+	return OkOrError();
+}
+
+// The batched inverse MDCT (4 channels per SIMD lane, see OggReader::set_batch_mdct_min_channels)
+// must give exactly the same PCM, also with fewer than 4 channels in the last batch.
+OkOrError checkBatchMdct(const TestFile& file) {
+	uint64_t n = file.ref.num_frames();
+	for(uint8_t min_channels : {1, 2, 3, 255}) {
+		CollectPcm callbacks;
+		OggReader reader(callbacks);
+		reader.set_batch_mdct_min_channels(min_channels);
+		CHECK_ERR(reader.full_read_from_memory(file.data.data(), file.data.size()));
+		CHECK_ERR(checkSamePcm(file.ref, callbacks, 0, n));
+		// And after a seek.
+		CollectPcm seek_callbacks;
+		OggReader seek_reader(seek_callbacks);
+		seek_reader.set_batch_mdct_min_channels(min_channels);
+		CHECK_ERR(seek_reader.set_reader(file.new_reader()));
+		CHECK_ERR(seek_reader.seek_to_sample(n / 3));
+		CHECK_ERR(seek_reader.read_until_end());
+		CHECK_ERR(checkSamePcm(file.ref, seek_callbacks, n / 3, n));
+	}
+	cout << file.filename << ": batch mdct ok" << endl;
+	return OkOrError();
+}
+
+int main(int argc, char** argv) {
+	// --same-pcm-as <ref.ogg>: the next file must decode to exactly the same PCM as ref.ogg,
+	// e.g. the same file with other page boundaries (see tests/repage-ogg.py).
+	const char* same_pcm_as = nullptr;
+	for(int i = 1; i < argc; ++i) {
+		if(string(argv[i]) == "--same-pcm-as" && i + 1 < argc) {
+			same_pcm_as = argv[++i];
+			continue;
+		}
+		TestFile file;
+		ASSERT_ERR(file.load(argv[i]));
+		if(same_pcm_as) {
+			TestFile ref;
+			ASSERT_ERR(ref.load(same_pcm_as));
+			ASSERT_ERR(checkSamePcm(ref.ref, file.ref, 0, ref.ref.num_frames()));
+			cout << file.filename << ": same PCM as " << ref.filename << endl;
+			same_pcm_as = nullptr;
+		}
+		ASSERT_ERR(checkSeek(file));
+		ASSERT_ERR(checkProbe(file));
+		ASSERT_ERR(checkSeekIndex(file));
+		ASSERT_ERR(checkSampleRange(file));
+		ASSERT_ERR(checkPull(file));
+		ASSERT_ERR(checkFeed(file));
+		ASSERT_ERR(checkFeedLatency(file));
+		ASSERT_ERR(checkLazyCrc(file));
+		ASSERT_ERR(checkInterleaved(file));
+		ASSERT_ERR(checkContextCache(file));
+		ASSERT_ERR(checkBatchMdct(file));
+	}
+	return 0;
+}
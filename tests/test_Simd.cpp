@@ -0,0 +1,322 @@
+//
+//  test_Simd.cpp
+//  ParseOggVorbis
+//
+//  Checks that the SIMD implementations give bit-identical results to the scalar reference.
+//  Build: g++ -std=c++11 -I src tests/test_Simd.cpp src/Simd.cpp src/mdct.cpp -o test_Simd
+//  Run: ./test_Simd
+//
+
+#include "Simd.hpp"
+#include "mdct.h"
+#include "Utils.hpp"
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Deterministic pseudo random float in [0, 1).
+static float randFloat(uint32_t& state) {
+	state = state * 1103515245 + 12345;
+	return float(state >> 8) / float(1 << 24);
+}
+
+typedef void (*MulAddFunc)(float* buf, const float* pcm, const float* win, size_t n);
+typedef void (*AddFunc)(float* buf, const float* pcm, size_t n);
+
+OkOrError checkMulAdd() {
+	// All lengths up to a few AVX vectors, i.e. all remainders of the SSE2 (4) and AVX (8) loops,
+	// and also unaligned (offset) pointers.
+	const size_t max_n = 67, max_offset = 3;
+	float pcm[max_n + max_offset], win[max_n + max_offset], ref[max_n + max_offset + 1], out[max_n + max_offset + 1];
+	vector<MulAddFunc> mul_add_funcs = {simd_mul_add_sse2, simd_mul_add};
+	vector<AddFunc> add_funcs = {simd_add_sse2, simd_add};
+	if(simd_avx_supported()) {
+		mul_add_funcs.push_back(simd_mul_add_avx);
+		add_funcs.push_back(simd_add_avx);
+	}
+	uint32_t state = 7;
+	for(size_t offset = 0; offset <= max_offset; ++offset)
+	for(size_t n = 0; n <= max_n; ++n) {
+		float init[max_n];
+		for(size_t i = 0; i < n; ++i) {
+			pcm[offset + i] = randFloat(state) * 2.f - 1.f;
+			win[offset + i] = randFloat(state);
+			init[i] = randFloat(state);
+		}
+		// One more than n, to check that nothing is written behind.
+		for(MulAddFunc func : mul_add_funcs) {
+			memcpy(ref + offset, init, n * sizeof(float));
+			memcpy(out + offset, init, n * sizeof(float));
+			ref[offset + n] = out[offset + n] = 42.f;
+			simd_mul_add_scalar(ref + offset, pcm + offset, win + offset, n);
+			func(out + offset, pcm + offset, win + offset, n);
+			CHECK(memcmp(ref + offset, out + offset, (n + 1) * sizeof(float)) == 0);
+		}
+		for(AddFunc func : add_funcs) {
+			memcpy(ref + offset, init, n * sizeof(float));
+			memcpy(out + offset, init, n * sizeof(float));
+			ref[offset + n] = out[offset + n] = 42.f;
+			simd_add_scalar(ref + offset, pcm + offset, n);
+			func(out + offset, pcm + offset, n);
+			CHECK(memcmp(ref + offset, out + offset, (n + 1) * sizeof(float)) == 0);
+		}
+	}
+	cout << "mul add ok (avx " << (simd_avx_supported() ? "tested" : "not supported") << ")" << endl;
+	return OkOrError();
+}
+
+OkOrError checkMulAddX4() {
+	// From the 4 interleaved channels, like Mdct::backward_x4 gives them, into 1 to 4 separate buffers.
+	// Against simd_mul_add_scalar/simd_add_scalar on the de-interleaved data.
+	const size_t max_n = 203;
+	float pcm4[max_n * 4], pcm[4][max_n], win[max_n], ref[4][max_n], out[4][max_n], out_scalar[4][max_n];
+	uint32_t state = 5;
+	for(size_t num_bufs = 1; num_bufs <= 4; ++num_bufs)
+	for(size_t n : {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 64, 203})
+	for(bool with_win : {true, false}) {
+		for(size_t i = 0; i < n * 4; ++i)
+			pcm4[i] = randFloat(state) * 2.f - 1.f;
+		for(size_t i = 0; i < n; ++i)
+			win[i] = randFloat(state);
+		float* bufs[4];
+		float* bufs_scalar[4];
+		for(size_t c = 0; c < num_bufs; ++c) {
+			for(size_t i = 0; i < n; ++i) {
+				pcm[c][i] = pcm4[i * 4 + c];
+				ref[c][i] = out[c][i] = out_scalar[c][i] = randFloat(state);
+			}
+			if(with_win) simd_mul_add_scalar(ref[c], pcm[c], win, n);
+			else simd_add_scalar(ref[c], pcm[c], n);
+			bufs[c] = out[c];
+			bufs_scalar[c] = out_scalar[c];
+		}
+		if(with_win) {
+			simd_mul_add_x4_scalar(bufs_scalar, num_bufs, pcm4, win, n);
+			simd_mul_add_x4(bufs, num_bufs, pcm4, win, n);
+		}
+		else {
+			simd_add_x4_scalar(bufs_scalar, num_bufs, pcm4, n);
+			simd_add_x4(bufs, num_bufs, pcm4, n);
+		}
+		for(size_t c = 0; c < num_bufs; ++c) {
+			CHECK(memcmp(ref[c], out_scalar[c], n * sizeof(float)) == 0);
+			CHECK(memcmp(ref[c], out[c], n * sizeof(float)) == 0);
+		}
+	}
+	cout << "mul add x4 ok" << endl;
+	return OkOrError();
+}
+
+typedef void (*InverseCouplingFunc)(float* mag, float* ang, size_t n);
+
+OkOrError checkInverseCoupling() {
+	// All combinations of the signs of magnitude and angle (spec 4.3.5), including +0 and -0,
+	// which take different branches (> 0) but compare equal, and equal magnitudes.
+	const float values[] = {-2.5f, -1.f, -0.25f, -0.f, 0.f, 0.25f, 1.f, 2.5f};
+	const size_t num_values = sizeof(values) / sizeof(values[0]);
+	vector<float> mag_all, ang_all;
+	for(float m : values)
+		for(float a : values) {
+			mag_all.push_back(m);
+			ang_all.push_back(a);
+		}
+	uint32_t state = 11;
+	for(size_t i = 0; i < 100; ++i) {
+		mag_all.push_back(randFloat(state) * 2.f - 1.f);
+		ang_all.push_back(randFloat(state) * 2.f - 1.f);
+	}
+	CHECK(mag_all.size() > num_values * num_values);
+	vector<InverseCouplingFunc> funcs = {simd_inverse_coupling_sse2, simd_inverse_coupling};
+	if(simd_avx_supported())
+		funcs.push_back(simd_inverse_coupling_avx);
+	// All lengths up to a few vectors (the loop remainders), and the whole set, also from an unaligned start.
+	vector<size_t> lengths;
+	for(size_t n = 0; n <= 19; ++n)
+		lengths.push_back(n);
+	for(size_t start : {0, 1, 3})
+		lengths.push_back(mag_all.size() - start);
+	for(size_t n : lengths)
+	for(size_t start : {0, 1, 3}) {
+		if(start + n > mag_all.size())
+			continue;
+		vector<float> mag_ref(mag_all.begin() + start, mag_all.begin() + start + n), ang_ref(ang_all.begin() + start, ang_all.begin() + start + n);
+		simd_inverse_coupling_scalar(mag_ref.data(), ang_ref.data(), n);
+		for(InverseCouplingFunc func : funcs) {
+			vector<float> mag(mag_all.begin() + start, mag_all.begin() + start + n), ang(ang_all.begin() + start, ang_all.begin() + start + n);
+			func(mag.data(), ang.data(), n);
+			// memcmp, such that -0 vs +0 is a difference (not on the null data of an empty vector).
+			CHECK(n == 0 || memcmp(mag.data(), mag_ref.data(), n * sizeof(float)) == 0);
+			CHECK(n == 0 || memcmp(ang.data(), ang_ref.data(), n * sizeof(float)) == 0);
+		}
+	}
+	cout << "inverse coupling ok (avx " << (simd_avx_supported() ? "tested" : "not supported") << ")" << endl;
+	return OkOrError();
+}
+
+// 16 byte aligned, as needed by mdct_backward_x4.
+static float* alignedFloats(vector<float>& storage, size_t n) {
+	storage.resize(n + 4);
+	return (float*) ((uintptr_t(storage.data()) + 15) & ~uintptr_t(15));
+}
+
+OkOrError checkMdct() {
+	// All power of two sizes which the SIMD code supports, from 64 (blocksize 6 is not allowed by the spec)
+	// up to 8192 (the max blocksize).
+	uint32_t state = 13;
+	for(int n = 64; n <= 8192; n *= 2) {
+		Mdct mdct;
+		mdct.init(n);
+		vector<float> in4_storage, out4_storage;
+		float* in4 = alignedFloats(in4_storage, n / 2 * 4);
+		float* out4 = alignedFloats(out4_storage, n * 4);
+		vector<vector<float>> in(4, vector<float>(n / 2)), ref(4, vector<float>(n));
+		for(int c = 0; c < 4; ++c) {
+			for(int i = 0; i < n / 2; ++i)
+				in4[i * 4 + c] = in[c][i] = randFloat(state) * 2.f - 1.f;
+			mdct_backward(&mdct.l, in[c].data(), ref[c].data());
+		}
+		vector<float> out(n);
+		vector<mdct_backward_func> funcs = {mdct_backward_sse2, mdct_backward_best()};
+		if(mdct_avx_supported())
+			funcs.push_back(mdct_backward_avx);
+		for(mdct_backward_func func : funcs)
+			for(int c = 0; c < 4; ++c) {
+				func(&mdct.l, in[c].data(), out.data());
+				CHECK(memcmp(out.data(), ref[c].data(), n * sizeof(float)) == 0);
+			}
+		mdct_backward_x4(&mdct.l, in4, out4);
+		for(int c = 0; c < 4; ++c)
+			for(int i = 0; i < n; ++i)
+				CHECK(memcmp(&out4[i * 4 + c], &ref[c][i], sizeof(float)) == 0);
+	}
+	cout << "mdct ok (avx " << (mdct_avx_supported() ? "tested" : "not supported") << ")" << endl;
+	return OkOrError();
+}
+
+OkOrError checkLspCurve() {
+	// Floor 0 (spec 6.2.3): w[i] = 2 cos(omega_i), lsp[j] = 2 cos(coefficient_j).
+	// n covers the remainders of the SIMD loops, m covers odd and even orders (up to the max of 255).
+	const size_t max_n = 203, max_m = 255;
+	float w[max_n], lsp[max_m], ref[max_n], out[max_n];
+	uint32_t state = 3;
+	for(size_t n : {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 64, 203})
+	for(size_t m : {1, 2, 3, 8, 15, 16, 31, 40, 255}) {
+		for(size_t i = 0; i < n; ++i)
+			w[i] = 2.f * cosf(randFloat(state) * float(M_PI));
+		for(size_t j = 0; j < m; ++j)
+			lsp[j] = 2.f * cosf(randFloat(state) * float(M_PI));
+		simd_lsp_curve_scalar(ref, w, n, lsp, m);
+		simd_lsp_curve_sse2(out, w, n, lsp, m);
+		CHECK(memcmp(ref, out, n * sizeof(float)) == 0);
+		if(simd_avx_supported()) {
+			simd_lsp_curve_avx(out, w, n, lsp, m);
+			CHECK(memcmp(ref, out, n * sizeof(float)) == 0);
+		}
+		simd_lsp_curve(out, w, n, lsp, m);
+		CHECK(memcmp(ref, out, n * sizeof(float)) == 0);
+	}
+	cout << "lsp curve ok (avx " << (simd_avx_supported() ? "tested" : "not supported") << ")" << endl;
+	return OkOrError();
+}
+
+typedef void (*FloatToInt16Func)(int16_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither);
+typedef void (*FloatToInt24Func)(int32_t* dst, size_t dst_stride, const float* src, size_t n, SimdDither* dither);
+
+// The SSE2 variant against the scalar one, with and without dither, for all strides of the interleaved output.
+// The dither state must also be the same afterwards, such that the next call continues the same sequence.
+template<typename T, typename Func>
+static OkOrError checkFloatToIntVariant(Func scalar, Func sse2, Func best, const vector<float>& src, size_t stride, bool dither) {
+	const T sentinel = 0x5a5a;
+	size_t n = src.size();
+	vector<T> ref(n * stride + 1, sentinel), out(n * stride + 1, sentinel), out_best(n * stride + 1, sentinel);
+	SimdDither ref_dither(7), dither_sse2(7), dither_best(7);
+	// Twice, to also check the continuation of the dither.
+	for(int k = 0; k < 2; ++k) {
+		scalar(ref.data(), stride, src.data(), n, dither ? &ref_dither : nullptr);
+		sse2(out.data(), stride, src.data(), n, dither ? &dither_sse2 : nullptr);
+		best(out_best.data(), stride, src.data(), n, dither ? &dither_best : nullptr);
+		CHECK(ref == out);
+		CHECK(ref == out_best);
+		CHECK(memcmp(ref_dither.state, dither_sse2.state, sizeof(ref_dither.state)) == 0);
+		CHECK(memcmp(ref_dither.state, dither_best.state, sizeof(ref_dither.state)) == 0);
+	}
+	// Only every stride-th value is written.
+	for(size_t i = 0; i < ref.size(); ++i)
+		if(i % stride != 0 || i >= n * stride)
+			CHECK(ref[i] == sentinel);
+	return OkOrError();
+}
+
+// Saturated lrintf(x * scale), i.e. without dither. NaN gives the minimum, like the SSE max/min.
+static int32_t expectedInt(float x, float scale, int32_t lo, int32_t hi) {
+	if(!(x * scale > float(lo)))
+		return lo;
+	if(!(x * scale < float(hi)))
+		return hi;
+	return int32_t(lrintf(x * scale));
+}
+
+OkOrError checkFloatToInt() {
+	// Random values, partly beyond [-1, 1] to saturate, and the special values.
+	vector<float> values;
+	uint32_t state = 5;
+	for(size_t i = 0; i < 200; ++i)
+		values.push_back((randFloat(state) * 2.f - 1.f) * 1.2f);
+	float specials[] = {
+		0.f, -0.f, 1.f, -1.f, 32767.f / 32768.f, 0.5f / 32768.f, 1.5f / 32768.f, -2.5f / 32768.f,
+		0.5f / 8388608.f, 1.5f / 8388608.f, 1e10f, -1e10f, INFINITY, -INFINITY, NAN, -NAN};
+	values.insert(values.begin() + 3, specials, specials + sizeof(specials) / sizeof(specials[0]));
+
+	// Without dither, against the direct expectation, including NaN and inf.
+	for(float x : values) {
+		int16_t v16;
+		int32_t v24;
+		simd_float_to_int16_scalar(&v16, 1, &x, 1, nullptr);
+		simd_float_to_int24_scalar(&v24, 1, &x, 1, nullptr);
+		CHECK(v16 == expectedInt(x, 32768.f, -32768, 32767));
+		CHECK(v24 == expectedInt(x, 8388608.f, -8388608, 8388607));
+	}
+
+	// All remainders of the SIMD loop, with the special values at all lane positions.
+	for(size_t n = 0; n <= values.size(); n += (n < 24) ? 1 : 37)
+	for(size_t start : {0, 1, 2, 3})
+	for(size_t stride : {1, 2, 3})
+	for(bool dither : {false, true}) {
+		if(start + n > values.size())
+			continue;
+		vector<float> src(values.begin() + start, values.begin() + start + n);
+		CHECK_ERR((checkFloatToIntVariant<int16_t, FloatToInt16Func>(simd_float_to_int16_scalar, simd_float_to_int16_sse2, simd_float_to_int16, src, stride, dither)));
+		CHECK_ERR((checkFloatToIntVariant<int32_t, FloatToInt24Func>(simd_float_to_int24_scalar, simd_float_to_int24_sse2, simd_float_to_int24, src, stride, dither)));
+	}
+
+	// The dither is TPDF in (-1, 1) LSB: at most one step away from the undithered value, and it changes something.
+	{
+		vector<float> src(values.begin(), values.begin() + 200);
+		vector<int16_t> plain(src.size()), dithered(src.size());
+		SimdDither dither;
+		simd_float_to_int16(plain.data(), 1, src.data(), src.size(), nullptr);
+		simd_float_to_int16(dithered.data(), 1, src.data(), src.size(), &dither);
+		size_t num_changed = 0;
+		for(size_t i = 0; i < src.size(); ++i) {
+			CHECK(abs(int(plain[i]) - int(dithered[i])) <= 1);
+			if(plain[i] != dithered[i])
+				++num_changed;
+		}
+		CHECK(num_changed > 0);
+	}
+	cout << "float to int ok" << endl;
+	return OkOrError();
+}
+
+int main() {
+	ASSERT_ERR(checkMulAdd());
+	ASSERT_ERR(checkMulAddX4());
+	ASSERT_ERR(checkInverseCoupling());
+	ASSERT_ERR(checkMdct());
+	ASSERT_ERR(checkLspCurve());
+	ASSERT_ERR(checkFloatToInt());
+	return 0;
+}
@@ -5,6 +5,9 @@
 //  Created by Albert Zeyer on 09.01.19.
 //  Copyright © 2019 Albert Zeyer. All rights reserved.
 //
+//  Build: g++ -std=c++11 -I src tests/test_Utils.cpp src/Utils.cpp -o test_Utils
+//  Run: ./test_Utils tests/audio/*.ogg
+//
 
 #include "Utils.hpp"
 #include <iostream>
@@ -40,6 +43,120 @@ OkOrError checkReadBits2(const char* data, size_t len, uint8_t n1, T1 v1, uint8_
 	return OkOrError();
 }
 
+template<typename T>
+OkOrError checkPacketReadBits(const char* data, size_t len, uint8_t numBits, T value, bool reachedEnd=false) {
+	PacketBitReader bitReader((const uint8_t*) data, len);
+	T out = bitReader.readBits<T>(numBits);
+	CHECK(bitReader.reachedEnd() == reachedEnd);
+	if(out != value)
+		std::cerr << std::hex << "out: 0x" << long(out) << ", value: 0x" << long(value) << std::dec << endl;
+	CHECK(out == value);
+	return OkOrError();
+}
+
+OkOrError checkPacketReadBitsSequence() {
+	// Compare against BitReader, also crossing the 64 bit refill boundary.
+	uint8_t data[37];
+	for(size_t i = 0; i < sizeof(data); ++i)
+		data[i] = uint8_t(i * 37 + 11);
+	ConstDataReader reader(data, sizeof(data));
+	BitReader bitReader(&reader);
+	PacketBitReader packetReader(data, sizeof(data));
+	int total = 0;
+	for(int i = 0; total + 32 <= int(sizeof(data)) * 8; ++i) {
+		int num = 1 + (i * 7) % 32;
+		CHECK(bitReader.readBits<uint32_t>(num) == packetReader.readBits<uint32_t>(num));
+		total += num;
+	}
+	CHECK(!packetReader.reachedEnd());
+	packetReader.readBits<uint32_t>(int(sizeof(data)) * 8 - total);
+	CHECK(!packetReader.reachedEnd());
+	CHECK(packetReader.readBitsT<1>() == 0);
+	CHECK(packetReader.reachedEnd());
+	return OkOrError();
+}
+
+OkOrError checkPacketPeekMaxBits() {
+	// The first refill (fast path) leaves exactly 56 bits, which must be enough for peekBits(56).
+	uint8_t data[16];
+	for(size_t i = 0; i < sizeof(data); ++i)
+		data[i] = uint8_t(i * 73 + 5);
+	ConstDataReader reader(data, sizeof(data));
+	BitReader bitReader(&reader);
+	PacketBitReader packetReader(data, sizeof(data));
+	for(int i = 0; i < 2; ++i) {
+		uint64_t v = packetReader.peekBits(56);
+		packetReader.consumeBits(56);
+		CHECK(v == bitReader.readBits<uint64_t>(56));
+	}
+	CHECK(!packetReader.reachedEnd());
+	return OkOrError();
+}
+
+OkOrError checkConstDataReaderView() {
+	const uint8_t data[5] = {1, 2, 3, 4, 5};
+	ConstDataReader reader(data, sizeof(data));
+	CHECK(reader.supportsView());
+	CHECK(reader.view(2) == data);
+	CHECK(reader.view(3) == data + 2);
+	CHECK(!reader.reachedEnd());
+	CHECK(reader.view(1) == nullptr);
+	CHECK(reader.reachedEnd());
+	return OkOrError();
+}
+
+// Maps the file, and compares view/read/seek/tell against FileReader (i.e. stdio).
+OkOrError checkMmapReader(const std::string& filename) {
+	FileReader file_reader(filename);
+	CHECK_ERR(file_reader.isValid());
+	size_t size = (size_t) file_reader.size();
+	std::vector<uint8_t> data(size);
+	CHECK(file_reader.read(data.data(), 1, size) == size);
+
+	MmapReader reader(filename);
+	CHECK_ERR(reader.isValid());
+	CHECK(reader.supportsView());
+	CHECK(reader.isSeekable());
+	CHECK(reader.size() == size);
+	CHECK(reader.tell() == 0);
+	// Sequential views of various sizes, over the whole file.
+	size_t pos = 0, step = 1;
+	while(pos < size) {
+		size_t len = std::min(step, size - pos);
+		const uint8_t* ptr = reader.view(len);
+		CHECK(ptr);
+		CHECK(memcmp(ptr, data.data() + pos, len) == 0);
+		pos += len;
+		CHECK(reader.tell() == pos);
+		step = step * 3 + 1;
+	}
+	CHECK(!reader.reachedEnd());
+	CHECK(reader.view(1) == nullptr);
+	CHECK(reader.reachedEnd());
+	// Seek back, and read (copy) at various positions. A seek also resets the end flag.
+	for(size_t seek_pos : {size_t(0), size / 3, size / 2, size - 1, size}) {
+		CHECK_ERR(reader.seek(seek_pos));
+		CHECK(!reader.reachedEnd());
+		CHECK(reader.tell() == seek_pos);
+		uint8_t buf[100];
+		size_t len = std::min(sizeof(buf), size - seek_pos);
+		CHECK(reader.read(buf, 1, len) == len);
+		CHECK(len == 0 || memcmp(buf, data.data() + seek_pos, len) == 0);
+		CHECK(reader.tell() == seek_pos + len);
+		// The view points directly into the mapping.
+		CHECK(reader.view(0) == (const uint8_t*) reader.map_ + seek_pos + len);
+	}
+	CHECK(reader.seek(size + 1).is_error_);
+	cout << filename << ": mmap reader ok (" << size << " bytes)" << endl;
+	return OkOrError();
+}
+
+OkOrError checkMmapReaderErrors() {
+	CHECK(MmapReader("does-not-exist.ogg").isValid().is_error_);
+	CHECK(MmapReader(".").isValid().is_error_); // not a regular file
+	return OkOrError();
+}
+
 void test_all() {
 	ASSERT_ERR(checkReadBits("\x00\x00\x00\x01", 4, 1, 0));
 	ASSERT_ERR(checkReadBits("\x01\x00\x00\x00", 4, 1, 1));
@@ -55,9 +172,20 @@ void test_all() {
 	ASSERT_ERR(checkReadBits("\x01\x02\x03\x04", 4, 32, 0x04030201));
 	ASSERT_ERR(checkReadBits2("\x01\x02\x00\x00", 4, 8, 1, 8, 2));
 	ASSERT_ERR(checkReadBits2("\x01\x01\x00\x00", 4, 7, 1, 8, 2));
+	ASSERT_ERR(checkPacketReadBits("\x02\x00\x00\x00", 4, 3, 2));
+	ASSERT_ERR(checkPacketReadBits("\x01\x02\x03\x04", 4, 32, 0x04030201));
+	ASSERT_ERR(checkPacketReadBits("\x01\x02\x03\x04\x05\x06\x07\x08\x09", 9, 64, uint64_t(0x0807060504030201)));
+	ASSERT_ERR(checkPacketReadBits("\xff\x01", 2, 16, 0x01ff));
+	ASSERT_ERR(checkPacketReadBits("\xff\x01", 2, 17, 0x01ff, true));
+	ASSERT_ERR(checkPacketReadBitsSequence());
+	ASSERT_ERR(checkPacketPeekMaxBits());
+	ASSERT_ERR(checkConstDataReaderView());
+	ASSERT_ERR(checkMmapReaderErrors());
 }
 
-int main() {
+int main(int argc, char** argv) {
 	test_all();
+	for(int i = 1; i < argc; ++i)
+		ASSERT_ERR(checkMmapReader(argv[i]));
 	return 0;
 }